@@ -0,0 +1,144 @@
+/*
+  Arduino core stand-in for the native (host) build
+
+  Provides just enough of the Arduino API, the Timer1 registers and
+  the Serial port for the firmware in src/ to build and run on Linux
+  against the simulated DS2482 and 1-Wire bus, see NativeSim.h.
+*/
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+
+#define F_CPU 16000000L
+
+#define HEX 16
+#define DEC 10
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define max(a,b) ((a)>(b)?(a):(b))
+#define min(a,b) ((a)<(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+void setup(void);
+void loop(void);
+
+// simulated clock, see NativeSim.cpp
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void noInterrupts(void);
+void interrupts(void);
+#define cli() noInterrupts()
+#define sei() interrupts()
+
+// Timer1 registers, advanced by the simulated clock
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint16_t OCR1A;
+extern volatile uint16_t OCR1B;
+extern volatile uint8_t TIMSK1;
+
+// interrupt flag register, writing a one clears the flag as on the AVR
+struct SimFlagRegister
+{
+	volatile uint8_t value;
+	SimFlagRegister& operator=(uint8_t v) { value &= ~v; return *this; }
+	SimFlagRegister& operator|=(uint8_t v) { value &= ~(value | v); return *this; }
+	operator uint8_t() const { return value; }
+};
+extern SimFlagRegister TIFR1;
+
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define TOV1   0
+#define OCF1A  1
+#define OCF1B  2
+
+// strings in flash, a plain pointer on the host
+class __FlashStringHelper;
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) ((const __FlashStringHelper *)(s))
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+
+#define ISR(vector) extern "C" void vector(void); void vector(void)
+
+class String
+{
+public:
+	String(const char *str = "") : s(str) {}
+	String(char c) : s(1, c) {}
+	String(int value, unsigned char base = DEC) { fromLong(value, base); }
+	String(unsigned int value, unsigned char base = DEC) { fromULong(value, base); }
+	String(unsigned char value, unsigned char base = DEC) { fromULong(value, base); }
+	String(long value, unsigned char base = DEC) { fromLong(value, base); }
+	String(unsigned long value, unsigned char base = DEC) { fromULong(value, base); }
+
+	String& operator+=(const String &rhs) { s += rhs.s; return *this; }
+	String& operator+=(const char *rhs) { s += rhs; return *this; }
+	friend String operator+(const String &lhs, const String &rhs) { String r(lhs); r += rhs; return r; }
+	friend String operator+(const char *lhs, const String &rhs) { String r(lhs); r += rhs; return r; }
+	friend String operator+(const String &lhs, const char *rhs) { String r(lhs); r += rhs; return r; }
+
+	const char* c_str() const { return s.c_str(); }
+	unsigned int length() const { return s.length(); }
+
+private:
+	std::string s;
+	void fromLong(long value, unsigned char base);
+	void fromULong(unsigned long value, unsigned char base);
+};
+
+class Print
+{
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	size_t write(const uint8_t *buffer, size_t size);
+	size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+	size_t print(const char *str) { return write(str); }
+	size_t print(const __FlashStringHelper *str) { return write((const char *)str); }
+	size_t print(const String &str) { return write(str.c_str()); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char value, int base = DEC) { return print((unsigned long)value, base); }
+	size_t print(int value, int base = DEC) { return print((long)value, base); }
+	size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+	size_t print(long value, int base = DEC);
+	size_t print(unsigned long value, int base = DEC);
+	size_t print(double value, int digits = 2);
+
+	size_t println(void) { return write("\r\n"); }
+	template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+	template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+};
+
+class HardwareSerial : public Print
+{
+public:
+	void begin(unsigned long baud) { mBaud = baud; }
+	int available(void) { return 0; }
+	int read(void) { return -1; }
+	void flush(void) {}
+	virtual size_t write(uint8_t c);
+	using Print::write;
+
+private:
+	unsigned long mBaud;
+};
+
+extern HardwareSerial Serial;
+
+#endif
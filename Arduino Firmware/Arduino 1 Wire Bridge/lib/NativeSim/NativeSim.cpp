@@ -0,0 +1,695 @@
+/*
+  Native (host) simulation of the bridge hardware
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "avr/sleep.h"
+#include "avr/power.h"
+#include "avr/eeprom.h"
+
+#include "NativeSim.h"
+#include "SimDS2482.h"
+
+extern "C" void TIMER1_OVF_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER1_COMPB_vect(void) __attribute__((weak));
+
+SimStats simStats;
+HardwareSerial Serial;
+TwoWire Wire;
+
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint16_t OCR1A;
+volatile uint16_t OCR1B;
+volatile uint8_t TIMSK1;
+SimFlagRegister TIFR1;
+
+static uint64_t now;			// ns since power up
+static uint64_t timer0Stopped;	// ns millis() has not counted
+static uint64_t timer1Fraction;	// ns since the last Timer1 tick
+static bool timer0Enabled = true;
+static bool interruptsEnabled = true;
+static unsigned long interruptCount;
+
+static std::vector<SimI2CDevice*> i2cDevices;
+
+//---------- clock and Timer1
+
+uint64_t simNanos(void)
+{
+	return now;
+}
+
+static void dispatchInterrupts(void)
+{
+	if (!interruptsEnabled)
+		return;
+
+	if ((TIFR1.value & (1 << OCF1A)) && (TIMSK1 & (1 << OCIE1A)))
+	{
+		TIFR1.value &= ~(1 << OCF1A);
+		interruptCount++;
+		if (TIMER1_COMPA_vect) TIMER1_COMPA_vect();
+	}
+	if ((TIFR1.value & (1 << OCF1B)) && (TIMSK1 & (1 << OCIE1B)))
+	{
+		TIFR1.value &= ~(1 << OCF1B);
+		interruptCount++;
+		if (TIMER1_COMPB_vect) TIMER1_COMPB_vect();
+	}
+	if ((TIFR1.value & (1 << TOV1)) && (TIMSK1 & (1 << TOIE1)))
+	{
+		TIFR1.value &= ~(1 << TOV1);
+		interruptCount++;
+		if (TIMER1_OVF_vect) TIMER1_OVF_vect();
+	}
+}
+
+// Timer1 tick length in ns for the prescaler selected in TCCR1B, 0 if stopped
+static uint64_t timer1TickNanos(void)
+{
+	static const uint16_t prescaler[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return (uint64_t)prescaler[TCCR1B & 7] * 1000000000ULL / F_CPU;
+}
+
+static void timer1Tick(void)
+{
+	TCNT1 = TCNT1 + 1;
+	if (TCNT1 == 0)
+		TIFR1.value |= (1 << TOV1);
+	if (TCNT1 == OCR1A)
+		TIFR1.value |= (1 << OCF1A);
+	if (TCNT1 == OCR1B)
+		TIFR1.value |= (1 << OCF1B);
+	dispatchInterrupts();
+}
+
+static void passTime(uint64_t ns)
+{
+	now += ns;
+	if (!timer0Enabled)
+		timer0Stopped += ns;
+}
+
+void simAdvance(uint64_t ns)
+{
+	while (ns > 0)
+	{
+		uint64_t tick = timer1TickNanos();
+		if (tick == 0)
+		{
+			passTime(ns);
+			return;
+		}
+
+		uint64_t left = tick - timer1Fraction;
+		if (ns < left)
+		{
+			timer1Fraction += ns;
+			passTime(ns);
+			return;
+		}
+
+		passTime(left);
+		ns -= left;
+		timer1Fraction = 0;
+		timer1Tick();
+	}
+}
+
+unsigned long millis(void)
+{
+	return (now - timer0Stopped) / 1000000ULL;
+}
+
+unsigned long micros(void)
+{
+	return (now - timer0Stopped) / 1000ULL;
+}
+
+void delay(unsigned long ms)
+{
+	simAdvance((uint64_t)ms * 1000000ULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+	simAdvance((uint64_t)us * 1000ULL);
+}
+
+void noInterrupts(void)
+{
+	interruptsEnabled = false;
+}
+
+void interrupts(void)
+{
+	interruptsEnabled = true;
+	dispatchInterrupts();
+}
+
+//---------- sleep and power
+
+void set_sleep_mode(uint8_t mode) {}
+void sleep_enable(void) {}
+void sleep_disable(void) {}
+
+// sleep until the next interrupt
+void sleep_cpu(void)
+{
+	unsigned long count = interruptCount;
+	uint64_t start = now;
+
+	if (timer1TickNanos() == 0 || (TIMSK1 & ((1 << TOIE1) | (1 << OCIE1A) | (1 << OCIE1B))) == 0)
+	{
+		fprintf(stderr, "[sim] sleep_cpu() with no wake up source\n");
+		exit(1);
+	}
+
+	while (count == interruptCount)
+		simAdvance(timer1TickNanos() - timer1Fraction);
+
+	simStats.sleepNanos += now - start;
+}
+
+void power_timer0_disable(void)
+{
+	timer0Enabled = false;
+}
+
+void power_all_enable(void)
+{
+	timer0Enabled = true;
+}
+
+//---------- EEPROM
+
+#define EEPROM_WRITE_NANOS 3300000ULL
+
+static uint8_t eeprom[E2END + 1];
+static const char *eepromFile;
+
+static void eepromLoad(void)
+{
+	memset(eeprom, 0xFF, sizeof(eeprom));
+	if (eepromFile == NULL) return;
+
+	FILE *f = fopen(eepromFile, "rb");
+	if (f == NULL) return;
+	if (fread(eeprom, 1, sizeof(eeprom), f) != sizeof(eeprom))
+		memset(eeprom, 0xFF, sizeof(eeprom));
+	fclose(f);
+}
+
+static void eepromSave(void)
+{
+	if (eepromFile == NULL) return;
+
+	FILE *f = fopen(eepromFile, "wb");
+	if (f == NULL) return;
+	fwrite(eeprom, 1, sizeof(eeprom), f);
+	fclose(f);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *p)
+{
+	return eeprom[(uintptr_t)p & E2END];
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+	bool changed = false;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		uint8_t *p = &eeprom[((uintptr_t)dst + i) & E2END];
+		if (*p == ((const uint8_t *)src)[i]) continue;
+		*p = ((const uint8_t *)src)[i];
+		simAdvance(EEPROM_WRITE_NANOS);
+		changed = true;
+	}
+	if (changed) eepromSave();
+}
+
+//---------- String and Print
+
+static void formatNumber(std::string &s, unsigned long value, uint8_t base, bool upper)
+{
+	char buf[8 * sizeof(long) + 1];
+	char *p = &buf[sizeof(buf) - 1];
+
+	if (base < 2)
+		base = 10;
+	*p = 0;
+	do
+	{
+		char c = value % base;
+		value /= base;
+		*--p = c < 10 ? c + '0' : c + (upper ? 'A' : 'a') - 10;
+	} while (value);
+	s += p;
+}
+
+void String::fromLong(long value, unsigned char base)
+{
+	if (value < 0 && base == DEC)
+	{
+		s = "-";
+		formatNumber(s, -value, base, false);
+	}
+	else
+		formatNumber(s, value, base, false);
+}
+
+void String::fromULong(unsigned long value, unsigned char base)
+{
+	formatNumber(s, value, base, false);
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+	size_t n = 0;
+	while (size--)
+		n += write(*buffer++);
+	return n;
+}
+
+size_t Print::print(long value, int base)
+{
+	std::string s;
+	if (value < 0 && base == DEC)
+	{
+		s = "-";
+		formatNumber(s, -value, base, true);
+	}
+	else
+		formatNumber(s, (unsigned long)value, base, true);
+	return write(s.c_str());
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+	std::string s;
+	formatNumber(s, value, base, true);
+	return write(s.c_str());
+}
+
+// same algorithm as the Arduino core, in single precision like the AVR
+size_t Print::print(double value, int digits)
+{
+	float number = value;
+	size_t n = 0;
+
+	if (isnan(number)) return write("nan");
+	if (isinf(number)) return write("inf");
+	if (number > 4294967040.0) return write("ovf");
+	if (number < -4294967040.0) return write("ovf");
+
+	if (number < 0.0)
+	{
+		n += write('-');
+		number = -number;
+	}
+
+	float rounding = 0.5;
+	for (uint8_t i = 0; i < digits; ++i)
+		rounding /= 10.0;
+	number += rounding;
+
+	unsigned long int_part = (unsigned long)number;
+	float remainder = number - (float)int_part;
+	n += print(int_part);
+
+	if (digits > 0)
+		n += write('.');
+
+	while (digits-- > 0)
+	{
+		remainder *= 10.0;
+		unsigned int toPrint = (unsigned int)remainder;
+		n += print(toPrint);
+		remainder -= toPrint;
+	}
+	return n;
+}
+
+//---------- profile
+
+static unsigned long reportCount;
+static uint8_t reportEnd = '\n';	// zero for binary frames
+
+static struct
+{
+	uint64_t time;
+	SimStats stats;
+} mark;
+
+static void profile(const char *what)
+{
+	uint64_t elapsed = now - mark.time;
+	uint64_t awake = elapsed - (simStats.sleepNanos - mark.stats.sleepNanos);
+
+	fprintf(stderr, "[sim] %s at %.3f s: awake %.1f ms, i2c %lu transactions %lu bytes %lu nacks, "
+		"1-Wire %lu resets %lu slots, serial %lu bytes\n",
+		what, now / 1e9, awake / 1e6,
+		simStats.i2cTransactions - mark.stats.i2cTransactions,
+		simStats.i2cBytes - mark.stats.i2cBytes,
+		simStats.i2cNacks - mark.stats.i2cNacks,
+		simStats.resets - mark.stats.resets,
+		simStats.slots - mark.stats.slots,
+		simStats.serialBytes - mark.stats.serialBytes);
+
+	mark.time = now;
+	mark.stats = simStats;
+}
+
+//---------- Serial
+
+size_t HardwareSerial::write(uint8_t c)
+{
+	putchar(c);
+	simStats.serialBytes++;
+	if (c == reportEnd)
+	{
+		char what[32];
+		fflush(stdout);
+		snprintf(what, sizeof(what), "report %lu", ++reportCount);
+		profile(what);
+	}
+	return 1;
+}
+
+//---------- Wire
+
+void simAttachI2C(SimI2CDevice *device)
+{
+	i2cDevices.push_back(device);
+}
+
+SimI2CDevice* simFindI2C(uint8_t address)
+{
+	for (size_t i = 0; i < i2cDevices.size(); i++)
+		if (i2cDevices[i]->address() == address)
+			return i2cDevices[i];
+	return NULL;
+}
+
+// start, address, bytes with acknowledge and stop on the bus
+static void i2cTransaction(uint8_t bytes, uint32_t clock)
+{
+	simStats.i2cTransactions++;
+	simStats.i2cBytes += bytes;
+	simAdvance(((uint64_t)(bytes + 1) * 9 + 2) * 1000000000ULL / clock);
+}
+
+TwoWire::TwoWire()
+{
+	txAddress = 0;
+	txLength = 0;
+	rxIndex = 0;
+	rxLength = 0;
+	mClock = 100000;
+}
+
+void TwoWire::begin(void)
+{
+	mClock = 100000;
+}
+
+void TwoWire::setClock(uint32_t clock)
+{
+	mClock = clock;
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+	txAddress = address;
+	txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+	if (txLength >= BUFFER_LENGTH)
+		return 0;
+	txBuffer[txLength++] = data;
+	return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+	SimI2CDevice *device = simFindI2C(txAddress);
+
+	i2cTransaction(device ? txLength : 0, mClock);
+	if (device == NULL)
+	{
+		simStats.i2cNacks++;
+		return 2;
+	}
+	if (!device->write(txBuffer, txLength))
+	{
+		simStats.i2cNacks++;
+		return 3;
+	}
+	return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+	SimI2CDevice *device = simFindI2C(address);
+
+	if (quantity > BUFFER_LENGTH)
+		quantity = BUFFER_LENGTH;
+
+	rxIndex = 0;
+	rxLength = 0;
+	i2cTransaction(device ? quantity : 0, mClock);
+	if (device == NULL)
+	{
+		simStats.i2cNacks++;
+		return 0;
+	}
+	for (uint8_t i = 0; i < quantity; i++)
+		rxBuffer[rxLength++] = device->read();
+	return quantity;
+}
+
+int TwoWire::available(void)
+{
+	return rxLength - rxIndex;
+}
+
+int TwoWire::read(void)
+{
+	if (rxIndex >= rxLength)
+		return -1;
+	return rxBuffer[rxIndex++];
+}
+
+//---------- environment
+
+static std::vector<SimDS18B20*> sensors;
+static std::vector<SimDS2413*> switches;
+static std::vector<double> baseTemperature;
+static std::vector<SimOneWireDevice*> devices;	// in -r / attach order
+
+// hot plugging, -u unplugs a device and -l plugs one in late
+#define HOTPLUG_START 60.0
+#define HOTPLUG_END   180.0
+static std::vector<int> unplugged;
+static std::vector<int> late;
+
+// slow temperature swings and heating / hot water calls from the Nest
+static void environment(void)
+{
+	double t = now / 1e9;
+
+	for (size_t i = 0; i < sensors.size(); i++)
+		sensors[i]->setTemperature(baseTemperature[i] + 0.5 * sin(2 * M_PI * (t / 600.0 + i / 7.0)));
+
+	for (size_t i = 0; i < switches.size(); i++)
+		switches[i]->setInputs(fmod(t + 30 * i, 240.0) < 100.0 ? 0 : 1, fmod(t + 30 * i, 420.0) < 60.0 ? 0 : 1);
+
+	for (size_t i = 0; i < unplugged.size(); i++)
+		if (unplugged[i] < (int)devices.size())
+			devices[unplugged[i]]->setConnected(t < HOTPLUG_START || t >= HOTPLUG_END);
+
+	for (size_t i = 0; i < late.size(); i++)
+		if (late[i] < (int)devices.size())
+			devices[late[i]]->setConnected(t >= HOTPLUG_START);
+}
+
+// parse 28-68-4d-c4-0b-00-00-8f
+static bool parseRom(const char *text, uint8_t *rom)
+{
+	unsigned int b[8];
+
+	if (sscanf(text, "%x-%x-%x-%x-%x-%x-%x-%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7]) != 8)
+		return false;
+	for (uint8_t i = 0; i < 8; i++)
+		rom[i] = b[i];
+	return true;
+}
+
+static void addDevice(SimOneWireBus &bus, const uint8_t *rom, bool parasite)
+{
+	if (rom[0] == 0x3A)
+	{
+		SimDS2413 *device = new SimDS2413(rom);
+		switches.push_back(device);
+		devices.push_back(device);
+		bus.attach(device);
+	}
+	else
+	{
+		static const double known[4] = { 21.3, 28.4, 42.6, 36.3 };
+		double base = sensors.size() < 4 ? known[sensors.size()] : 20.0 + sensors.size() * 0.7;
+		SimDS18B20 *device = new SimDS18B20(rom, base, parasite);
+		sensors.push_back(device);
+		baseTemperature.push_back(base);
+		devices.push_back(device);
+		bus.attach(device);
+	}
+}
+
+// the devices are dealt out over the bridges, then over their channels
+static SimOneWireBus& nextBus(std::vector<SimDS2482*> &bridges, int channels)
+{
+	size_t n = devices.size();
+
+	return bridges[n % bridges.size()]->bus((n / bridges.size()) % channels);
+}
+
+// the sensors from template.json, then generated ones
+static void defaultRom(uint8_t family, unsigned int index, uint8_t *rom)
+{
+	static const uint8_t known[][8] = {
+		{ 0x28, 0x68, 0x4d, 0xc4, 0x0b, 0x00, 0x00, 0x8f },
+		{ 0x28, 0x8c, 0x37, 0xc4, 0x03, 0x00, 0x00, 0x8f },
+		{ 0x28, 0x89, 0x45, 0xc4, 0x03, 0x00, 0x00, 0x8a },
+		{ 0x28, 0x5b, 0x7d, 0xc4, 0x03, 0x00, 0x00, 0x9a },
+		{ 0x3a, 0x9d, 0x3f, 0x57, 0x00, 0x00, 0x00, 0xd1 },
+	};
+
+	if (family == 0x28 && index < 4)
+		memcpy(rom, known[index], 8);
+	else if (family == 0x3A && index < 1)
+		memcpy(rom, known[4], 8);
+	else
+	{
+		rom[0] = family;
+		rom[1] = index * 37 + 11;
+		rom[2] = index * 101 + 3;
+		rom[3] = 0xC4;
+		rom[4] = index >> 4;
+		rom[5] = rom[6] = 0;
+		rom[7] = SimOneWireDevice::crc8(rom, 7);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int temperatureCount = 4;
+	int switchCount = 1;
+	unsigned long reports = 3;
+	bool parasite = false;
+	int channels = 1;
+	int bridgeCount = 1;
+	bool restart = false;
+	std::vector<const char*> roms;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:s:c:r:u:l:e:a:pwb8")) != -1)
+	{
+		switch (opt)
+		{
+			case 't': temperatureCount = atoi(optarg); break;
+			case 's': switchCount = atoi(optarg); break;
+			case 'c': reports = strtoul(optarg, NULL, 10); break;
+			case 'r': roms.push_back(optarg); break;
+			case 'p': parasite = true; break;
+			case 'w': restart = true; break;
+			case 'u': unplugged.push_back(atoi(optarg)); break;
+			case 'l': late.push_back(atoi(optarg)); break;
+			case 'e': eepromFile = optarg; break;
+			case 'b': reportEnd = 0; break;
+			case '8': channels = 8; break;
+			case 'a': bridgeCount = constrain(atoi(optarg), 1, 4); break;
+			default:
+				fprintf(stderr, "usage: %s [-t sensors] [-s switches] [-c reports] [-r rom]... [-u device]... [-l device]... [-e eeprom] [-a bridges] [-p] [-w] [-b] [-8]\n", argv[0]);
+				return 1;
+		}
+	}
+
+	std::vector<SimDS2482*> bridges;
+	uint8_t rom[8];
+
+	for (int i = 0; i < bridgeCount; i++)
+	{
+		bridges.push_back(new SimDS2482(i, channels));
+		simAttachI2C(bridges[i]);
+	}
+
+	if (roms.size() > 0)
+	{
+		for (size_t i = 0; i < roms.size(); i++)
+		{
+			if (!parseRom(roms[i], rom))
+			{
+				fprintf(stderr, "bad rom %s\n", roms[i]);
+				return 1;
+			}
+			addDevice(nextBus(bridges, channels), rom, parasite);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < temperatureCount; i++)
+		{
+			defaultRom(0x28, i, rom);
+			addDevice(nextBus(bridges, channels), rom, parasite);
+		}
+		for (int i = 0; i < switchCount; i++)
+		{
+			defaultRom(0x3A, i, rom);
+			addDevice(nextBus(bridges, channels), rom, parasite);
+		}
+	}
+	if (restart)
+	{
+		for (size_t i = 0; i < bridges.size(); i++)
+			bridges[i]->leaveState(channels - 1, true);
+		for (size_t i = 0; i < devices.size(); i++)
+			devices[i]->leaveOverdrive();
+	}
+	eepromLoad();
+
+	environment();
+	setup();
+	profile("setup");
+
+	while (reportCount < reports)
+	{
+		environment();
+		loop();
+	}
+
+	unsigned long busyNacks = 0;
+	for (size_t i = 0; i < bridges.size(); i++)
+		busyNacks += bridges[i]->busyNacks;
+	fprintf(stderr, "[sim] DS2482 refused %lu commands while busy\n", busyNacks);
+	return 0;
+}
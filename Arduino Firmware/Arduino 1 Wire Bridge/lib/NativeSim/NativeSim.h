@@ -0,0 +1,69 @@
+/*
+  Native (host) simulation of the bridge hardware
+
+  Runs the firmware setup() / loop() on Linux against a simulated clock,
+  Timer1, TWI bus, DS2482 and 1-Wire bus so cycle time and bus traffic
+  can be profiled without hardware. Serial output goes to stdout, one
+  profile line per report goes to stderr. Reports end with a new line,
+  or with a zero byte for the binary frames with -b. Devices are numbered
+  in attach order, sensors first: -u unplugs one from 60 s to 180 s and
+  -l keeps one unplugged until 60 s, to watch hot plug detection. The
+  EEPROM is kept in the file given with -e, so a second run is a warm boot.
+  With -8 the bridge is a DS2482-800 and the devices are dealt out over its
+  8 channels in turn, for firmware built with -D BRIDGE_CHANNELS=8. With
+  -a 2 to -a 4 there are that many bridges at addresses 0 and up, the
+  devices are dealt out over them first, for -D BRIDGE_COUNT to match.
+  With -w only the MCU restarts: the bridges keep the state the last run
+  left them in, at overdrive on their last channel, and so do the
+  switches that can do overdrive.
+
+  Usage: program [-t sensors] [-s switches] [-c reports] [-r rom]...
+                 [-u device]... [-l device]... [-e eeprom] [-a bridges]
+                 [-p] [-w] [-b] [-8]
+*/
+
+#ifndef NativeSim_h
+#define NativeSim_h
+
+#include <inttypes.h>
+
+// simulated time in nanoseconds since power up
+uint64_t simNanos(void);
+
+// let simulated time pass, firing Timer1 interrupts on the way
+void simAdvance(uint64_t ns);
+
+// counters, the profile line on stderr shows how much each report cost
+typedef struct
+{
+	unsigned long i2cTransactions;
+	unsigned long i2cBytes;
+	unsigned long i2cNacks;
+	unsigned long resets;	// 1-Wire resets
+	unsigned long slots;	// 1-Wire time slots
+	unsigned long serialBytes;
+	uint64_t sleepNanos;	// time spent in sleep_cpu()
+} SimStats;
+
+extern SimStats simStats;
+
+// I2C slave on the simulated TWI bus
+class SimI2CDevice
+{
+public:
+	virtual ~SimI2CDevice() {}
+
+	// 7 bit address
+	virtual uint8_t address() = 0;
+
+	// master write of len bytes, returns false to NACK
+	virtual bool write(const uint8_t *data, uint8_t len) = 0;
+
+	// master read of one byte
+	virtual uint8_t read() = 0;
+};
+
+void simAttachI2C(SimI2CDevice *device);
+SimI2CDevice* simFindI2C(uint8_t address);
+
+#endif
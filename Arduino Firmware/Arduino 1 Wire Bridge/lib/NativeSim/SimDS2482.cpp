@@ -0,0 +1,213 @@
+/*
+  Simulated DS2482-100 / DS2482-800 I2C to 1-Wire bridge
+*/
+
+#include "SimDS2482.h"
+
+// registers as addressed by the set read pointer command
+#define REG_STATUS  0xF0
+#define REG_DATA    0xE1
+#define REG_CONFIG  0xC3
+#define REG_CHANNEL 0xD2
+
+#define STATUS_1WB (1<<0)
+#define STATUS_PPD (1<<1)
+#define STATUS_LL  (1<<3)
+#define STATUS_RST (1<<4)
+#define STATUS_SBR (1<<5)
+#define STATUS_TSB (1<<6)
+#define STATUS_DIR (1<<7)
+
+#define CONFIG_1WS (1<<3)
+
+// 1-Wire timing from the DS2482 datasheet in ns, standard / overdrive
+#define T_RESET_STD 1148000
+#define T_RESET_OD   146000
+#define T_SLOT_STD    69000
+#define T_SLOT_OD     10500
+
+// channel selection codes and the value read back for channel 0-7
+static const uint8_t channelCode[8] = { 0xF0, 0xE1, 0xD2, 0xC3, 0xB4, 0xA5, 0x96, 0x87 };
+static const uint8_t channelRead[8] = { 0xB8, 0xB1, 0xAA, 0xA3, 0x9C, 0x95, 0x8E, 0x87 };
+
+SimDS2482::SimDS2482(uint8_t addr, uint8_t channels)
+{
+	mAddress = 0x18 | (addr & 3);
+	mChannels = channels;
+	busyNacks = 0;
+	deviceReset();
+}
+
+void SimDS2482::deviceReset()
+{
+	status = STATUS_RST | STATUS_LL;
+	data = 0;
+	config = 0;
+	readPtr = REG_STATUS;
+	busyUntil = 0;
+	mChannel = 0;
+}
+
+void SimDS2482::leaveState(uint8_t channel, bool overdrive)
+{
+	mChannel = channel % mChannels;
+	if (overdrive)
+		config |= CONFIG_1WS;
+	status &= ~STATUS_RST;
+}
+
+bool SimDS2482::busy() const
+{
+	return simNanos() < busyUntil;
+}
+
+bool SimDS2482::overdrive() const
+{
+	return (config & CONFIG_1WS) != 0;
+}
+
+// the 1-Wire line is busy for the given number of time slots
+void SimDS2482::oneWire(uint64_t slots)
+{
+	busyUntil = simNanos() + slots * (overdrive() ? T_SLOT_OD : T_SLOT_STD);
+	readPtr = REG_STATUS;
+}
+
+bool SimDS2482::write(const uint8_t *cmd, uint8_t len)
+{
+	uint8_t i, bit, id, cmp, dir;
+
+	// address only, as sent by an I2C scan
+	if (len == 0)
+		return true;
+
+	switch (cmd[0])
+	{
+		case 0xF0: // device reset
+			deviceReset();
+			return true;
+
+		case 0xE1: // set read pointer
+			if (len < 2)
+				return false;
+			if (cmd[1] != REG_STATUS && cmd[1] != REG_DATA && cmd[1] != REG_CONFIG &&
+				(cmd[1] != REG_CHANNEL || mChannels == 1))
+				return false;
+			readPtr = cmd[1];
+			return true;
+
+		case 0xD2: // write configuration
+			if (len < 2)
+				return false;
+			if (busy())
+			{
+				busyNacks++;
+				return false;
+			}
+			if ((cmd[1] >> 4) != (~cmd[1] & 0x0F))
+				return false;
+			config = cmd[1] & 0x0F;
+			status &= ~STATUS_RST;
+			readPtr = REG_CONFIG;
+			return true;
+
+		case 0xC3: // channel select, DS2482-800 only
+			if (mChannels == 1 || len < 2)
+				return false;
+			if (busy())
+			{
+				busyNacks++;
+				return false;
+			}
+			for (i = 0; i < mChannels; i++)
+			{
+				if (channelCode[i] == cmd[1])
+				{
+					mChannel = i;
+					readPtr = REG_CHANNEL;
+					return true;
+				}
+			}
+			return false;
+	}
+
+	// 1-Wire commands are refused while the line is busy
+	if (busy())
+	{
+		busyNacks++;
+		return false;
+	}
+
+	SimOneWireBus &wire = buses[mChannel];
+
+	switch (cmd[0])
+	{
+		case 0xB4: // 1-Wire reset
+			status &= ~(STATUS_PPD | STATUS_RST);
+			if (wire.reset(overdrive()))
+				status |= STATUS_PPD;
+			busyUntil = simNanos() + (overdrive() ? T_RESET_OD : T_RESET_STD);
+			readPtr = REG_STATUS;
+			return true;
+
+		case 0xA5: // 1-Wire write byte
+			if (len < 2)
+				return false;
+			for (i = 0; i < 8; i++)
+				wire.slot((cmd[1] >> i) & 1, overdrive());
+			oneWire(8);
+			return true;
+
+		case 0x96: // 1-Wire read byte
+			data = 0;
+			for (i = 0; i < 8; i++)
+				data |= wire.slot(1, overdrive()) << i;
+			oneWire(8);
+			return true;
+
+		case 0x87: // 1-Wire single bit
+			if (len < 2)
+				return false;
+			bit = wire.slot(cmd[1] >> 7, overdrive());
+			if (bit)
+				status |= STATUS_SBR;
+			else
+				status &= ~STATUS_SBR;
+			oneWire(1);
+			return true;
+
+		case 0x78: // 1-Wire triplet
+			if (len < 2)
+				return false;
+			id = wire.slot(1, overdrive());
+			cmp = wire.slot(1, overdrive());
+			if (id != cmp)
+				dir = id;
+			else if (id)
+				dir = 1;
+			else
+				dir = cmd[1] >> 7;
+			wire.slot(dir, overdrive());
+			status &= ~(STATUS_SBR | STATUS_TSB | STATUS_DIR);
+			status |= (id ? STATUS_SBR : 0) | (cmp ? STATUS_TSB : 0) | (dir ? STATUS_DIR : 0);
+			oneWire(3);
+			return true;
+	}
+
+	return false;
+}
+
+uint8_t SimDS2482::read()
+{
+	switch (readPtr)
+	{
+		case REG_DATA:
+			return data;
+		case REG_CONFIG:
+			return config;
+		case REG_CHANNEL:
+			return channelRead[mChannel];
+		default:
+			return busy() ? status | STATUS_1WB : status & ~STATUS_1WB;
+	}
+}
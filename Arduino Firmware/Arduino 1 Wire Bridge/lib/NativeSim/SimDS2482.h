@@ -0,0 +1,53 @@
+/*
+  Simulated DS2482-100 / DS2482-800 I2C to 1-Wire bridge
+
+  Models the status, read data, configuration and channel selection
+  registers, the read pointer, 1-Wire busy timing at standard and
+  overdrive speed, and NACKs commands sent while the 1-Wire line is
+  busy the same way the real part does.
+*/
+
+#ifndef SimDS2482_h
+#define SimDS2482_h
+
+#include "NativeSim.h"
+#include "SimOneWire.h"
+
+class SimDS2482 : public SimI2CDevice
+{
+public:
+	// addr is the AD1/AD0 pin setting 0-3, channels is 1 (-100) or 8 (-800)
+	SimDS2482(uint8_t addr, uint8_t channels = 1);
+
+	SimOneWireBus& bus(uint8_t channel = 0) { return buses[channel]; }
+
+	virtual uint8_t address() { return mAddress; }
+	virtual bool write(const uint8_t *data, uint8_t len);
+	virtual uint8_t read();
+
+	// the state an earlier firmware run left the chip in: the DS2482 keeps
+	// it when only the MCU restarts, as when the host opens the serial port
+	void leaveState(uint8_t channel, bool overdrive);
+
+	// commands sent while the 1-Wire line was busy
+	unsigned long busyNacks;
+
+private:
+	uint8_t mAddress;
+	uint8_t mChannels;
+	uint8_t mChannel;
+	SimOneWireBus buses[8];
+
+	uint8_t status;
+	uint8_t data;
+	uint8_t config;
+	uint8_t readPtr;
+	uint64_t busyUntil;
+
+	bool busy() const;
+	bool overdrive() const;
+	void oneWire(uint64_t slots);
+	void deviceReset();
+};
+
+#endif
@@ -0,0 +1,556 @@
+/*
+  Simulated 1-Wire bus and slave devices for the native (host) build
+*/
+
+#include "SimOneWire.h"
+#include "NativeSim.h"
+
+#include <math.h>
+#include <string.h>
+
+// ROM commands
+#define SIM_READROM        0x33
+#define SIM_MATCHROM       0x55
+#define SIM_SKIPROM        0xCC
+#define SIM_SEARCHROM      0xF0
+#define SIM_ALARMSEARCH    0xEC
+#define SIM_RESUME         0xA5
+#define SIM_OVERDRIVESKIP  0x3C
+#define SIM_OVERDRIVEMATCH 0x69
+
+SimOneWireDevice::SimOneWireDevice(const uint8_t *address)
+{
+	memcpy(rom, address, 8);
+	overdriveCapable = false;
+	resumeCapable = false;
+	romState = ROM_IDLE;
+	fnState = FN_IDLE;
+	mConnected = true;
+	mOverdrive = false;
+	mResume = false;
+	bitCount = 0;
+	accum = 0;
+	searchPhase = 0;
+	txLength = 0;
+	txPos = 0;
+}
+
+bool SimOneWireDevice::reset(bool overdrive)
+{
+	romState = ROM_IDLE;
+	if (!mConnected)
+		return false;
+
+	// a standard speed reset returns every device to standard speed,
+	// devices at standard speed do not see an overdrive reset
+	if (!overdrive)
+		mOverdrive = false;
+	else if (!mOverdrive)
+		return false;
+
+	romState = ROM_COMMAND;
+	bitCount = 0;
+	accum = 0;
+	return true;
+}
+
+uint8_t SimOneWireDevice::slot(uint8_t masterBit, bool overdrive)
+{
+	uint8_t b;
+
+	if (!mConnected || romState == ROM_IDLE)
+		return 1;
+
+	// time slots at the wrong speed are not recognised
+	if (overdrive != mOverdrive)
+	{
+		romState = ROM_IDLE;
+		return 1;
+	}
+
+	masterBit &= 1;
+	switch (romState)
+	{
+		case ROM_COMMAND:
+			accum |= masterBit << bitCount;
+			if (++bitCount == 8)
+				romCommand(accum);
+			return 1;
+
+		case ROM_MATCH:
+			if (masterBit != romBit(bitCount))
+			{
+				mResume = false;
+				romState = ROM_IDLE;
+				return 1;
+			}
+			if (++bitCount == 64)
+			{
+				mResume = true;
+				romState = FUNCTION;
+				functionBegin();
+			}
+			return 1;
+
+		case ROM_READ:
+			b = romBit(bitCount);
+			if (++bitCount == 64)
+			{
+				mResume = true;
+				romState = FUNCTION;
+				functionBegin();
+			}
+			return b;
+
+		case ROM_SEARCH:
+			b = romBit(bitCount);
+			if (searchPhase == 0)
+			{
+				searchPhase = 1;
+				return b;
+			}
+			if (searchPhase == 1)
+			{
+				searchPhase = 2;
+				return b ^ 1;
+			}
+			searchPhase = 0;
+			if (masterBit != b)
+			{
+				mResume = false;
+				romState = ROM_IDLE;
+				return 1;
+			}
+			if (++bitCount == 64)
+			{
+				mResume = true;
+				romState = FUNCTION;
+				functionBegin();
+			}
+			return 1;
+
+		case FUNCTION:
+			return functionSlot(masterBit);
+
+		default:
+			return 1;
+	}
+}
+
+void SimOneWireDevice::romCommand(uint8_t cmd)
+{
+	bitCount = 0;
+	searchPhase = 0;
+	romState = ROM_IDLE;
+
+	switch (cmd)
+	{
+		case SIM_READROM:
+			romState = ROM_READ;
+			break;
+		case SIM_MATCHROM:
+			romState = ROM_MATCH;
+			break;
+		case SIM_SKIPROM:
+			mResume = false;
+			romState = FUNCTION;
+			functionBegin();
+			break;
+		case SIM_SEARCHROM:
+			romState = ROM_SEARCH;
+			break;
+		case SIM_ALARMSEARCH:
+			if (alarm())
+				romState = ROM_SEARCH;
+			else
+				mResume = false;
+			break;
+		case SIM_RESUME:
+			if (resumeCapable && mResume)
+			{
+				romState = FUNCTION;
+				functionBegin();
+			}
+			break;
+		case SIM_OVERDRIVESKIP:
+			if (overdriveCapable)
+			{
+				mOverdrive = true;
+				mResume = false;
+				romState = FUNCTION;
+				functionBegin();
+			}
+			break;
+		case SIM_OVERDRIVEMATCH:
+			if (overdriveCapable)
+			{
+				mOverdrive = true;
+				romState = ROM_MATCH;
+			}
+			break;
+	}
+}
+
+uint8_t SimOneWireDevice::functionSlot(uint8_t masterBit)
+{
+	uint8_t b;
+
+	switch (fnState)
+	{
+		case FN_RX:
+			accum |= masterBit << bitCount;
+			if (++bitCount == 8)
+			{
+				b = accum;
+				accum = 0;
+				bitCount = 0;
+				functionByte(b);
+			}
+			return 1;
+
+		case FN_TX:
+			if (txPos == txLength && !(refill() && txPos < txLength))
+			{
+				fnState = FN_IDLE;
+				return 1;
+			}
+			b = (txBuffer[txPos] >> bitCount) & 1;
+			if (++bitCount == 8)
+			{
+				bitCount = 0;
+				txPos++;
+			}
+			return b;
+
+		case FN_STATUS:
+			return statusBit();
+
+		default:
+			return 1;
+	}
+}
+
+void SimOneWireDevice::receive()
+{
+	fnState = FN_RX;
+	bitCount = 0;
+	accum = 0;
+}
+
+void SimOneWireDevice::send(const uint8_t *data, uint8_t len)
+{
+	if (len > sizeof(txBuffer))
+		len = sizeof(txBuffer);
+	memcpy(txBuffer, data, len);
+	txLength = len;
+	txPos = 0;
+	bitCount = 0;
+	fnState = FN_TX;
+}
+
+void SimOneWireDevice::status()
+{
+	fnState = FN_STATUS;
+}
+
+void SimOneWireDevice::ignore()
+{
+	fnState = FN_IDLE;
+}
+
+uint8_t SimOneWireDevice::crc8(const uint8_t *data, uint8_t len)
+{
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < len; i++)
+	{
+		uint8_t inbyte = data[i];
+		for (uint8_t j = 0; j < 8; j++)
+		{
+			uint8_t mix = (crc ^ inbyte) & 0x01;
+			crc >>= 1;
+			if (mix)
+				crc ^= 0x8C;
+			inbyte >>= 1;
+		}
+	}
+	return crc;
+}
+
+//---------- DS18B20
+
+#define SIM_STARTCONVO      0x44
+#define SIM_COPYSCRATCH     0x48
+#define SIM_READSCRATCH     0xBE
+#define SIM_WRITESCRATCH    0x4E
+#define SIM_RECALLSCRATCH   0xB8
+#define SIM_READPOWERSUPPLY 0xB4
+
+SimDS18B20::SimDS18B20(const uint8_t *address, double celsius, bool parasite)
+	: SimOneWireDevice(address)
+{
+	conversions = 0;
+	scratchpadReads = 0;
+	mCelsius = celsius;
+	mParasite = parasite;
+	command = 0;
+	writeCount = 0;
+	convertDone = 0;
+	convertCelsius = celsius;
+
+	// DS28EA00 can do overdrive and resume
+	overdriveCapable = resumeCapable = rom[0] == 0x42;
+
+	// factory defaults
+	eeprom[0] = 0x4B;
+	eeprom[1] = 0x46;
+	eeprom[2] = rom[0] == 0x10 ? 0xFF : 0x7F;
+
+	scratchpad[2] = eeprom[0];
+	scratchpad[3] = eeprom[1];
+	scratchpad[4] = eeprom[2];
+	scratchpad[5] = 0xFF;
+	scratchpad[6] = 0x0C;
+	scratchpad[7] = 0x10;
+
+	// power on value
+	latchTemperature(85.0);
+}
+
+uint8_t SimDS18B20::getResolution() const
+{
+	if (rom[0] == 0x10)
+		return 12;
+	return ((scratchpad[4] >> 5) & 3) + 9;
+}
+
+void SimDS18B20::latchTemperature(double celsius)
+{
+	if (celsius < -55.0)
+		celsius = -55.0;
+	if (celsius > 125.0)
+		celsius = 125.0;
+
+	if (rom[0] == 0x10)
+	{
+		// 9 bit register, extended resolution through COUNT_REMAIN / COUNT_PER_C
+		int16_t raw = (int16_t)floor(celsius * 2 + 0.5);
+		int16_t whole = raw >> 1;
+		int remain = 16 - (int)floor((celsius - whole + 0.25) * 16 + 0.5);
+		if (remain < 0)
+			remain = 0;
+		if (remain > 16)
+			remain = 16;
+		scratchpad[0] = raw & 0xFF;
+		scratchpad[1] = (raw >> 8) & 0xFF;
+		scratchpad[6] = remain;
+		scratchpad[7] = 16;
+	}
+	else
+	{
+		int16_t raw = (int16_t)floor(celsius * 16 + 0.5);
+		raw &= ~((1 << (12 - getResolution())) - 1);
+		scratchpad[0] = raw & 0xFF;
+		scratchpad[1] = (raw >> 8) & 0xFF;
+	}
+}
+
+void SimDS18B20::update()
+{
+	if (convertDone != 0 && simNanos() >= convertDone)
+	{
+		latchTemperature(convertCelsius);
+		convertDone = 0;
+	}
+}
+
+void SimDS18B20::functionByte(uint8_t b)
+{
+	update();
+
+	if (command == SIM_WRITESCRATCH)
+	{
+		// TH, TL and configuration (not on the DS18S20)
+		uint8_t count = rom[0] == 0x10 ? 2 : 3;
+		if (writeCount < count)
+		{
+			if (writeCount == 2)
+				b = (b & 0x60) | 0x1F;
+			scratchpad[2 + writeCount++] = b;
+		}
+		return;
+	}
+
+	command = b;
+	switch (b)
+	{
+		case SIM_STARTCONVO:
+			conversions++;
+			convertCelsius = mCelsius;
+			convertDone = simNanos() + (uint64_t)(93750000.0 * (1 << (getResolution() - 9)));
+			status();
+			break;
+
+		case SIM_READSCRATCH:
+			scratchpadReads++;
+			scratchpad[8] = crc8(scratchpad, 8);
+			send(scratchpad, 9);
+			break;
+
+		case SIM_WRITESCRATCH:
+			writeCount = 0;
+			receive();
+			break;
+
+		case SIM_COPYSCRATCH:
+			memcpy(eeprom, scratchpad + 2, 3);
+			status();
+			break;
+
+		case SIM_RECALLSCRATCH:
+			memcpy(scratchpad + 2, eeprom, 3);
+			status();
+			break;
+
+		case SIM_READPOWERSUPPLY:
+			status();
+			break;
+
+		default:
+			ignore();
+			break;
+	}
+}
+
+uint8_t SimDS18B20::statusBit()
+{
+	update();
+
+	switch (command)
+	{
+		case SIM_STARTCONVO:
+			// a parasite powered device cannot signal the end of a conversion
+			return mParasite || convertDone == 0 ? 1 : 0;
+		case SIM_READPOWERSUPPLY:
+			return mParasite ? 0 : 1;
+		default:
+			return 1;
+	}
+}
+
+bool SimDS18B20::alarm()
+{
+	int16_t whole;
+
+	update();
+	if (rom[0] == 0x10)
+		whole = (int16_t)(scratchpad[0] | (scratchpad[1] << 8)) >> 1;
+	else
+		whole = (int16_t)(scratchpad[0] | (scratchpad[1] << 8)) >> 4;
+
+	return whole >= (int8_t)scratchpad[2] || whole <= (int8_t)scratchpad[3];
+}
+
+//---------- DS2413
+
+#define SIM_PIOACCESSREAD  0xF5
+#define SIM_PIOACCESSWRITE 0x5A
+
+SimDS2413::SimDS2413(const uint8_t *address)
+	: SimOneWireDevice(address)
+{
+	reads = 0;
+	writes = 0;
+	overdriveCapable = true;
+	resumeCapable = true;
+	latch = 0x03;
+	inputA = 1;
+	inputB = 1;
+	command = 0;
+	writeCount = 0;
+	writeData = 0;
+}
+
+uint8_t SimDS2413::pioStatus() const
+{
+	uint8_t latchA = latch & 1;
+	uint8_t latchB = (latch >> 1) & 1;
+	uint8_t status = (latchA & inputA) | (latchA << 1) | ((latchB & inputB) << 2) | (latchB << 3);
+
+	return ((~status << 4) & 0xF0) | status;
+}
+
+void SimDS2413::functionByte(uint8_t b)
+{
+	if (command == SIM_PIOACCESSWRITE)
+	{
+		// data byte followed by its inverse
+		if (writeCount++ == 0)
+		{
+			writeData = b;
+			return;
+		}
+		if (b == (uint8_t)~writeData)
+		{
+			uint8_t confirm[2] = { 0xAA, 0 };
+			writes++;
+			latch = writeData & 0x03;
+			confirm[1] = pioStatus();
+			send(confirm, 2);
+		}
+		else
+			ignore();
+		return;
+	}
+
+	command = b;
+	switch (b)
+	{
+		case SIM_PIOACCESSREAD:
+			reads++;
+			send(pioStatus());
+			break;
+
+		case SIM_PIOACCESSWRITE:
+			writeCount = 0;
+			receive();
+			break;
+
+		default:
+			ignore();
+			break;
+	}
+}
+
+bool SimDS2413::refill()
+{
+	// the PIO status is repeated until the next reset
+	if (command != SIM_PIOACCESSREAD)
+		return false;
+	send(pioStatus());
+	return true;
+}
+
+//---------- bus
+
+bool SimOneWireBus::reset(bool overdrive)
+{
+	bool presence = false;
+
+	for (size_t i = 0; i < devices.size(); i++)
+		presence |= devices[i]->reset(overdrive);
+
+	simStats.resets++;
+	return presence;
+}
+
+uint8_t SimOneWireBus::slot(uint8_t masterBit, bool overdrive)
+{
+	uint8_t level = masterBit & 1;
+
+	for (size_t i = 0; i < devices.size(); i++)
+		level &= devices[i]->slot(masterBit, overdrive);
+
+	simStats.slots++;
+	return level;
+}
@@ -0,0 +1,155 @@
+/*
+  Simulated 1-Wire bus and slave devices for the native (host) build
+
+  Devices are modelled at time slot level: the bus master (the simulated
+  DS2482) issues resets and time slots and every device on the bus answers
+  through the ROM layer (read, match, skip, search, alarm search, resume,
+  overdrive skip and match) and its own function layer.
+*/
+
+#ifndef SimOneWire_h
+#define SimOneWire_h
+
+#include <inttypes.h>
+#include <vector>
+
+class SimOneWireDevice
+{
+public:
+	SimOneWireDevice(const uint8_t *rom);
+	virtual ~SimOneWireDevice() {}
+
+	const uint8_t* getRom() const { return rom; }
+
+	// a disconnected device ignores the bus
+	void setConnected(bool connected) { mConnected = connected; }
+	bool isConnected() const { return mConnected; }
+
+	// left at overdrive by a transaction the master never ended with a
+	// standard speed reset, if the device can do overdrive
+	void leaveOverdrive() { mOverdrive = overdriveCapable; }
+
+	// bus events, return the level the device drives (1 = released)
+	bool reset(bool overdrive);
+	uint8_t slot(uint8_t masterBit, bool overdrive);
+
+	// 1-Wire CRC8 over len bytes
+	static uint8_t crc8(const uint8_t *data, uint8_t len);
+
+protected:
+	uint8_t rom[8];
+	bool overdriveCapable;
+	bool resumeCapable;
+
+	// function layer
+	virtual void functionBegin() { receive(); }
+	virtual void functionByte(uint8_t b) {}
+	virtual uint8_t statusBit() { return 1; }
+	virtual bool refill() { return false; }
+	virtual bool alarm() { return false; }
+
+	void receive();
+	void send(const uint8_t *data, uint8_t len);
+	void send(uint8_t b) { send(&b, 1); }
+	void status();
+	void ignore();
+
+private:
+	enum { ROM_IDLE, ROM_COMMAND, ROM_MATCH, ROM_SEARCH, ROM_READ, FUNCTION } romState;
+	enum { FN_IDLE, FN_RX, FN_TX, FN_STATUS } fnState;
+
+	bool mConnected;
+	bool mOverdrive;
+	bool mResume;
+
+	uint8_t bitCount;
+	uint8_t accum;
+	uint8_t searchPhase;
+
+	uint8_t txBuffer[16];
+	uint8_t txLength;
+	uint8_t txPos;
+
+	uint8_t romBit(uint8_t i) const { return (rom[i >> 3] >> (i & 7)) & 1; }
+	void romCommand(uint8_t cmd);
+	uint8_t functionSlot(uint8_t masterBit);
+};
+
+// DS18B20 family (0x28, 0x22, 0x3B, 0x42) and DS18S20 (0x10) temperature sensor
+class SimDS18B20 : public SimOneWireDevice
+{
+public:
+	SimDS18B20(const uint8_t *rom, double celsius, bool parasite = false);
+
+	void setTemperature(double celsius) { mCelsius = celsius; }
+	double getTemperature() const { return mCelsius; }
+
+	uint8_t getResolution() const;
+
+	// number of conversions and scratchpad reads done so far
+	unsigned long conversions;
+	unsigned long scratchpadReads;
+
+protected:
+	virtual void functionBegin() { command = 0; receive(); }
+	virtual void functionByte(uint8_t b);
+	virtual uint8_t statusBit();
+	virtual bool alarm();
+
+private:
+	double mCelsius;
+	bool mParasite;
+	uint8_t scratchpad[9];
+	uint8_t eeprom[3];
+	uint8_t command;
+	uint8_t writeCount;
+	uint64_t convertDone;
+	double convertCelsius;
+
+	void update();
+	void latchTemperature(double celsius);
+};
+
+// DS2413 dual channel addressable switch
+class SimDS2413 : public SimOneWireDevice
+{
+public:
+	SimDS2413(const uint8_t *rom);
+
+	// level driven onto the PIO pins from outside, 1 = released
+	void setInputs(uint8_t pioa, uint8_t piob) { inputA = pioa; inputB = piob; }
+	uint8_t getLatches() const { return latch; }
+
+	unsigned long reads;
+	unsigned long writes;
+
+protected:
+	virtual void functionBegin() { command = 0; receive(); }
+	virtual void functionByte(uint8_t b);
+	virtual bool refill();
+
+private:
+	uint8_t latch;
+	uint8_t inputA;
+	uint8_t inputB;
+	uint8_t command;
+	uint8_t writeCount;
+	uint8_t writeData;
+
+	uint8_t pioStatus() const;
+};
+
+class SimOneWireBus
+{
+public:
+	void attach(SimOneWireDevice *device) { devices.push_back(device); }
+
+	// returns true if a presence pulse was seen
+	bool reset(bool overdrive);
+	// master writes masterBit (1 for a read slot), returns the line level
+	uint8_t slot(uint8_t masterBit, bool overdrive);
+
+	std::vector<SimOneWireDevice*> devices;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  Wire (TWI) stand-in for the native (host) build
+
+  Transactions are handed to the simulated I2C devices registered with
+  NativeSim and take simulated bus time at the selected clock.
+*/
+
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire
+{
+public:
+	TwoWire();
+	void begin(void);
+	void setClock(uint32_t clock);
+	void beginTransmission(uint8_t address);
+	uint8_t endTransmission(bool sendStop = true);
+	uint8_t requestFrom(uint8_t address, uint8_t quantity);
+	size_t write(uint8_t data);
+	int available(void);
+	int read(void);
+
+private:
+	uint8_t txAddress;
+	uint8_t txBuffer[BUFFER_LENGTH];
+	uint8_t txLength;
+	uint8_t rxBuffer[BUFFER_LENGTH];
+	uint8_t rxIndex;
+	uint8_t rxLength;
+	uint32_t mClock;
+};
+
+extern TwoWire Wire;
+
+#endif
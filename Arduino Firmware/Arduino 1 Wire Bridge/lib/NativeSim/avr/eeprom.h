@@ -0,0 +1,21 @@
+/*
+  avr/eeprom.h stand-in for the native (host) build, 1 KB of EEPROM
+  like the ATmega328P. It starts erased, or from the file given with -e,
+  which is written back on every update so a second run is a warm boot.
+*/
+
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define E2END 0x3FF
+
+uint8_t eeprom_read_byte(const uint8_t *p);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+
+// writes only the bytes that differ, each costs a 3.3 ms write cycle
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+#endif
@@ -0,0 +1,17 @@
+/*
+  avr/power.h stand-in for the native (host) build, only timer0 is
+  tracked as it stops millis() while disabled.
+*/
+
+#ifndef _AVR_POWER_H_
+#define _AVR_POWER_H_
+
+void power_timer0_disable(void);
+void power_all_enable(void);
+
+#define power_adc_disable()
+#define power_spi_disable()
+#define power_timer2_disable()
+#define power_twi_disable()
+
+#endif
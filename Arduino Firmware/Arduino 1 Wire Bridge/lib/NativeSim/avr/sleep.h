@@ -0,0 +1,18 @@
+/*
+  avr/sleep.h stand-in for the native (host) build, sleep_cpu() advances
+  the simulated clock to the next enabled Timer1 interrupt.
+*/
+
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE 0
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable(void);
+void sleep_disable(void);
+void sleep_cpu(void);
+
+#endif
@@ -45,33 +45,80 @@ void DS18B20_DS2482::setOneWire(DS2482* _DS2482){
     bitResolution = 12;
     waitForConversion = true;
     checkForConversion = true;
+    conversionPending = false;
+    conversionParasite = false;
+    conversionBroadcast = false;
+    channelMask = 1;
+    alarmChannel = 0;
+    readMode = READ_FULL;
+    plausibleStep = PLAUSIBLE_STEP;
 
 }
 
 // initialise the bus
 void DS18B20_DS2482::begin(void){
 
-    DeviceAddress deviceAddress;
-
-    _wire->wireResetSearch();
     devices = 0; // Reset the number of devices when we enumerate wire devices
+    channelMask = 0;
 
-    while (_wire->wireSearch(deviceAddress)){
+    for (uint8_t i = 0; i < _wire->getDeviceCount(); i++){
 
-        if (validAddress(deviceAddress) && validFamily(deviceAddress)){
+        DeviceAddress& deviceAddress = _wire->getDeviceAtIndex(i);
 
-            if (!parasite && readPowerSupply(deviceAddress)) parasite = true;
+        if (validFamily(deviceAddress)){
 
-//            ScratchPad scratchPad;
+            DeviceInfo& info = _wire->getDeviceInfoAtIndex(i);
 
-//            readScratchPad(deviceAddress, scratchPad);
+            // read once, a list loaded from the EEPROM has it already
+            if (info.resolution != 0 || updateDeviceInfo(deviceAddress)){
+
+                if (info.flags & DEVICE_PARASITE) parasite = true;
+
+                bitResolution = max(bitResolution, info.resolution);
+            }
 
-            bitResolution = max(bitResolution, getResolution(deviceAddress));
+            // the DS28EA00 takes Resume, handy after a conversion by address
+            if (deviceAddress[0] == DS28EA00MODEL) info.flags |= DEVICE_RESUME;
 
+            channelMask |= 1 << info.channel;
             devices++;
         }
     }
 
+    // without sensors a conversion still goes to channel 0 as it always did
+    if (channelMask == 0) channelMask = 1;
+
+}
+
+uint8_t DS18B20_DS2482::rescan(void){
+
+    static const uint8_t families[] = { DS18S20MODEL, DS1822MODEL, DS18B20MODEL, DS1825MODEL, DS28EA00MODEL };
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < sizeof(families); i++)
+        count += _wire->rescanFamily(families[i]);
+
+    begin();
+    return count;
+
+}
+
+// reads the resolution and power mode of a device into the DS2482 device list
+// returns false if the device is not listed or cannot be read
+bool DS18B20_DS2482::updateDeviceInfo(uint8_t* deviceAddress){
+
+    DeviceInfo* info = _wire->getDeviceInfo(deviceAddress);
+    if (info == NULL) return false;
+
+    info->resolution = getResolution(deviceAddress);
+    if (info->resolution == 0) return false;
+
+    if (readPowerSupply(deviceAddress)) info->flags |= DEVICE_PARASITE;
+    else info->flags &= ~DEVICE_PARASITE;
+
+    info->conversionTime = millisToWaitForConversion(info->resolution);
+    return true;
+
 }
 
 // returns the number of devices found on the bus
@@ -84,20 +131,23 @@ bool DS18B20_DS2482::validAddress(uint8_t* deviceAddress){
     return (_wire->crc8(deviceAddress, 7) == deviceAddress[7]);
 }
 
-// finds an address at a given index on the bus
+// finds the address of the device at a given index among the devices
+// of the families this library supports, from the DS2482 device list
 // returns true if the device was found
 bool DS18B20_DS2482::getAddress(uint8_t* deviceAddress, uint8_t index){
 
-    uint8_t depth = 0;
+    for (uint8_t i = 0; i < _wire->getDeviceCount(); i++){
 
-    _wire->wireResetSearch();
+        DeviceAddress& address = _wire->getDeviceAtIndex(i);
 
-    while (depth <= index && _wire->wireSearch(deviceAddress)) {
-        if (depth == index && validAddress(deviceAddress)) return true;
-        depth++;
+        if (validFamily(address) && index-- == 0){
+            for (uint8_t j = 0; j < 8; j++) deviceAddress[j] = address[j];
+            return true;
+        }
     }
 
     return false;
+
 }
 
 // attempt to determine if the device at the given address is connected to the bus
@@ -116,13 +166,12 @@ bool DS18B20_DS2482::isConnected(uint8_t* deviceAddress, uint8_t* scratchPad)
     return b && (_wire->crc8(scratchPad, 8) == scratchPad[SCRATCHPAD_CRC]);
 }
 
-bool DS18B20_DS2482::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad){
+bool DS18B20_DS2482::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad, uint8_t length){
 
-	// send the reset command and fail fast
-    int b = _wire->reset();
-    if (b == 0) return false;
+	// send the reset command and fail fast, Skip ROM only when the CRC
+	// is read too and would catch a second device answering
+    if (!_wire->select(deviceAddress, length == 9)) return false;
 
-    _wire->wireSelect(deviceAddress);
     _wire->wireWriteByte(READSCRATCH);
 
     // Read all registers in a simple loop
@@ -138,19 +187,18 @@ bool DS18B20_DS2482::readScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad)
     // byte 7: DS18S20: COUNT_PER_C
     //         DS18B20 & DS1822: store for crc
     // byte 8: SCRATCHPAD_CRC
-    for(uint8_t i = 0; i < 9; i++){
+    for(uint8_t i = 0; i < length; i++){
         scratchPad[i] = _wire->wireReadByte();
     }
 
-    b = _wire->reset();
+    int b = _wire->reset();
     return (b == 1);
 }
 
 
-void DS18B20_DS2482::writeScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad){
+void DS18B20_DS2482::writeScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad, bool copyToEeprom){
 
-    _wire->reset();
-    _wire->wireSelect(deviceAddress);
+    _wire->select(deviceAddress);
     _wire->wireWriteByte(WRITESCRATCH);
     _wire->wireWriteByte(scratchPad[HIGH_ALARM_TEMP]); // high alarm temp
     _wire->wireWriteByte(scratchPad[LOW_ALARM_TEMP]); // low alarm temp
@@ -160,6 +208,8 @@ void DS18B20_DS2482::writeScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad
 
     _wire->reset();
 
+    if (!copyToEeprom) return;
+
     // save the newly written values to eeprom
     _wire->wireSelect(deviceAddress);
     //_wire->wireWriteByte(COPYSCRATCH, parasite);
@@ -174,8 +224,7 @@ void DS18B20_DS2482::writeScratchPad(uint8_t* deviceAddress, uint8_t* scratchPad
 bool DS18B20_DS2482::readPowerSupply(uint8_t* deviceAddress){
 
     bool ret = false;
-    _wire->reset();
-    _wire->wireSelect(deviceAddress);
+    _wire->select(deviceAddress);
     _wire->wireWriteByte(READPOWERSUPPLY);
     if (_wire->wireReadBit() == 0) ret = true;
     _wire->reset();
@@ -205,7 +254,7 @@ bool DS18B20_DS2482::setResolution(uint8_t* deviceAddress, uint8_t newResolution
 	newResolution = constrain(newResolution, 9, 12);
 			
     // return when stored value == new value
-    if(getResolution(deviceAddress) == newResolution) return true;
+    if(cachedResolution(deviceAddress) == newResolution) return true;
 
     ScratchPad scratchPad;
     if (isConnected(deviceAddress, scratchPad)){
@@ -230,6 +279,12 @@ bool DS18B20_DS2482::setResolution(uint8_t* deviceAddress, uint8_t newResolution
             }
             writeScratchPad(deviceAddress, scratchPad);
 
+            DeviceInfo* info = _wire->getDeviceInfo(deviceAddress);
+            if (info != NULL){
+                info->resolution = newResolution;
+                info->conversionTime = millisToWaitForConversion(newResolution);
+            }
+
             // without calculation we can always set it to max
 			bitResolution = max(bitResolution, newResolution);
 			
@@ -239,7 +294,7 @@ bool DS18B20_DS2482::setResolution(uint8_t* deviceAddress, uint8_t newResolution
 				for (int i=0; i<devices; i++)
 				{
 					getAddress(deviceAddr, i);
-					bitResolution = max(bitResolution, getResolution(deviceAddr));
+					bitResolution = max(bitResolution, cachedResolution(deviceAddr));
 				}
 			}
         }
@@ -255,6 +310,16 @@ uint8_t DS18B20_DS2482::getResolution(){
     return bitResolution;
 }
 
+// returns the resolution from the device list, only asks the device
+// if it is not listed or its resolution is not known yet
+uint8_t DS18B20_DS2482::cachedResolution(uint8_t* deviceAddress){
+
+    DeviceInfo* info = _wire->getDeviceInfo(deviceAddress);
+    if (info != NULL && info->resolution != 0) return info->resolution;
+    return getResolution(deviceAddress);
+
+}
+
 // returns the current resolution of the device, 9-12
 // returns 0 if device not found
 uint8_t DS18B20_DS2482::getResolution(uint8_t* deviceAddress){
@@ -312,23 +377,28 @@ bool DS18B20_DS2482::getCheckForConversion(){
     return checkForConversion;
 }
 
+// after a startConversion() every channel with sensors must be done,
+// the sensors answer read slots with 0 until then
 bool DS18B20_DS2482::isConversionComplete()
 {
-   uint8_t b = _wire->wireReadBit();
-   return (b == 1);
+   if (!conversionBroadcast) return _wire->wireReadBit() == 1;
+
+   for (uint8_t channel = 0; channel < 8; channel++){
+       if (!(channelMask & (1 << channel))) continue;
+       _wire->useChannel(channel);
+       if (_wire->wireReadBit() != 1) return false;
+   }
+   return true;
 }
 
 // sends command for all devices on the bus to perform a temperature conversion
 void DS18B20_DS2482::requestTemperatures(){
 
-    _wire->reset();
-    _wire->wireSkip();
-    //_wire->wireWriteByte(STARTCONVO, parasite);
-	_wire->wireWriteByte(STARTCONVO);
+    int16_t delms = startConversion();
 
     // ASYNC mode?
     if (!waitForConversion) return;
-    blockTillConversionComplete(bitResolution);
+    blockTillConversionComplete(delms);
 
 }
 
@@ -337,40 +407,117 @@ void DS18B20_DS2482::requestTemperatures(){
 // returns TRUE  otherwise
 bool DS18B20_DS2482::requestTemperaturesByAddress(uint8_t* deviceAddress){
 
-    uint8_t bitResolution = getResolution(deviceAddress);
-    if (bitResolution == 0){
-     return false; //Device disconnected
+    int16_t delms = startConversionByAddress(deviceAddress);
+    if (delms == 0) return false;
+
+    // ASYNC mode?
+    if (!waitForConversion) return true;
+
+    blockTillConversionComplete(delms);
+
+    return true;
+
+}
+
+// sends command for all devices on the bus to perform a temperature conversion
+// and returns without waiting
+int16_t DS18B20_DS2482::startConversion(){
+
+    bool answered = false;
+
+    conversionPending = false;
+
+    // the convert command only holds the bus for its own bytes, so every
+    // channel with sensors is started back to back and they all convert
+    // at the same time
+    for (uint8_t channel = 0; channel < 8; channel++){
+
+        if (!(channelMask & (1 << channel))) continue;
+
+        _wire->useChannel(channel);
+        if (_wire->reset() == 0) continue;
+
+        _wire->wireSkip();
+        //_wire->wireWriteByte(STARTCONVO, parasite);
+        _wire->wireWriteByte(STARTCONVO);
+        answered = true;
     }
 
-    if (_wire->reset() == 0){
-        return false;
+    if (!answered) return 0;
+
+    conversionPending = true;
+    conversionBroadcast = true;
+    conversionParasite = parasite;
+    return millisToWaitForConversion(bitResolution);
+
+}
+
+// sends command for one device to perform a temperature conversion by address
+// and returns without waiting
+int16_t DS18B20_DS2482::startConversionByAddress(uint8_t* deviceAddress){
+
+    DeviceInfo* info = _wire->getDeviceInfo(deviceAddress);
+    int16_t delms;
+
+    conversionPending = false;
+
+    if (info != NULL && info->resolution != 0){
+        delms = info->conversionTime;
+    } else {
+        uint8_t bitResolution = getResolution(deviceAddress);
+        if (bitResolution == 0){
+         return 0; //Device disconnected
+        }
+        delms = millisToWaitForConversion(bitResolution);
+    }
+
+    // a second device taking a Skip ROM would only convert as well
+    if (!_wire->select(deviceAddress, true)){
+        return 0;
     }
 
-    _wire->wireSelect(deviceAddress);
     //_wire->wireWriteByte(STARTCONVO, parasite);
 	_wire->wireWriteByte(STARTCONVO);
 
+    conversionPending = true;
+    conversionBroadcast = false;
+    conversionParasite = info != NULL ? (info->flags & DEVICE_PARASITE) : parasite;
+    return delms;
 
-    // ASYNC mode?
-    if (!waitForConversion) return true;
+}
 
-    blockTillConversionComplete(bitResolution);
+bool DS18B20_DS2482::isConversionPending(){
+    return conversionPending;
+}
 
-    return true;
+// returns true once the started conversion is complete
+bool DS18B20_DS2482::poll(){
+
+    if (conversionPending && checkForConversion && !conversionParasite && isConversionComplete())
+        conversionPending = false;
+
+    return !conversionPending;
 
 }
 
+// returns true once the started conversion is complete or its deadline has passed
+bool DS18B20_DS2482::isReady(bool deadline){
+
+    if (deadline) conversionPending = false;
+    return poll();
+
+}
 
 // Continue to check if the IC has responded with a temperature
-void DS18B20_DS2482::blockTillConversionComplete(uint8_t bitResolution){
+void DS18B20_DS2482::blockTillConversionComplete(int16_t delms){
     
-    int delms = millisToWaitForConversion(bitResolution);
-    if (checkForConversion && !parasite){
+    if (checkForConversion && !conversionParasite){
         unsigned long now = millis();
         while(!isConversionComplete() && (millis() - delms < now));
     } else {
         delay(delms);
     }
+    conversionPending = false;
     
 }
 
@@ -459,11 +606,19 @@ int16_t DS18B20_DS2482::calculateTemperature(uint8_t* deviceAddress, uint8_t* sc
     */
 
     if (deviceAddress[0] == DS18S20MODEL){
-        fpTemperature = ((fpTemperature & 0xfff0) << 3) - 16 +
-            (
-                ((scratchPad[COUNT_PER_C] - scratchPad[COUNT_REMAIN]) << 7) /
-                  scratchPad[COUNT_PER_C]
-            );
+        int16_t countRemain;
+
+        // DS18S20 is hard-wired to 16 counts per degree, a shift does the
+        // division; only the DS1820 needs the real division
+        if (scratchPad[COUNT_PER_C] == 16)
+            countRemain = (16 - scratchPad[COUNT_REMAIN]) << 3;
+        else if (scratchPad[COUNT_PER_C] != 0)
+            countRemain = ((scratchPad[COUNT_PER_C] - scratchPad[COUNT_REMAIN]) << 7) /
+                            scratchPad[COUNT_PER_C];
+        else
+            countRemain = 0;
+
+        fpTemperature = ((fpTemperature & 0xfff0) << 3) - 16 + countRemain;
     }
 
     return fpTemperature;
@@ -483,6 +638,88 @@ int16_t DS18B20_DS2482::getTemp(uint8_t* deviceAddress){
 
 }
 
+// a device that does not answer reads 0xFFFF, -0.0625 C, which is never
+// taken from a short read, and the power on value is 85 C, taken only if
+// the last reading was close. A short read is never taken for a DS18S20
+// as the extended resolution needs COUNT_REMAIN and COUNT_PER_C
+int16_t DS18B20_DS2482::getTemp(uint8_t* deviceAddress, int16_t last){
+
+    ScratchPad scratchPad;
+    int16_t raw;
+
+    if (shortRead(deviceAddress, last) && readScratchPad(deviceAddress, scratchPad, TEMP_MSB + 1)){
+
+        raw = calculateTemperature(deviceAddress, scratchPad);
+        if (plausible(scratchPad, raw, last)) return raw;
+    }
+
+    return getTemp(deviceAddress);
+
+}
+
+bool DS18B20_DS2482::shortRead(uint8_t* deviceAddress, int16_t last){
+    return readMode == READ_SHORT && last != DEVICE_DISCONNECTED_RAW && deviceAddress[0] != DS18S20MODEL;
+}
+
+// all ones is an open line even when it is close to the last reading,
+// the full read with the CRC tells the two apart
+bool DS18B20_DS2482::plausible(uint8_t* scratchPad, int16_t raw, int16_t last){
+    if (scratchPad[TEMP_LSB] == 0xFF && scratchPad[TEMP_MSB] == 0xFF) return false;
+    return abs((int32_t)raw - last) <= plausibleStep;
+}
+
+// the checks are those of getTemp(), a short read that is not taken
+// falls back to a full read of that sensor alone
+void DS18B20_DS2482::getTemps(DS18B20_DS2482** sensors, uint8_t** addresses, int16_t* last, uint8_t count){
+
+    static const uint8_t command = READSCRATCH;
+    WireTransfer transfers[MAXBRIDGES];
+    ScratchPad scratchPads[MAXBRIDGES];
+    bool shortReads[MAXBRIDGES];
+    int16_t raw;
+
+    if (count > MAXBRIDGES) count = MAXBRIDGES;
+
+    for (uint8_t i = 0; i < count; i++){
+        shortReads[i] = sensors[i]->shortRead(addresses[i], last[i]);
+
+        transfers[i].bridge = sensors[i]->_wire;
+        transfers[i].address = addresses[i];
+        transfers[i].tx = &command;
+        transfers[i].txLength = 1;
+        transfers[i].rx = scratchPads[i];
+        transfers[i].rxLength = shortReads[i] ? TEMP_MSB + 1 : 9;
+        transfers[i].allowSkip = !shortReads[i]; // the CRC is checked
+    }
+
+    DS2482::transfer(transfers, count);
+
+    for (uint8_t i = 0; i < count; i++){
+
+        if (transfers[i].present){
+            raw = sensors[i]->calculateTemperature(addresses[i], scratchPads[i]);
+
+            if (shortReads[i] ? sensors[i]->plausible(scratchPads[i], raw, last[i]) :
+                DS2482::crc8(scratchPads[i], 8) == scratchPads[i][SCRATCHPAD_CRC]){
+                last[i] = raw;
+                continue;
+            }
+        }
+
+        last[i] = shortReads[i] ? sensors[i]->getTemp(addresses[i]) : DEVICE_DISCONNECTED_RAW;
+    }
+
+}
+
+void DS18B20_DS2482::setReadMode(uint8_t mode, int16_t step){
+    readMode = mode;
+    plausibleStep = step;
+}
+
+uint8_t DS18B20_DS2482::getReadMode(void){
+    return readMode;
+}
+
 // returns temperature in degrees C or DEVICE_DISCONNECTED_C if the
 // device's scratch pad cannot be read successfully.
 // the numeric value of DEVICE_DISCONNECTED_C is defined in
@@ -514,16 +751,16 @@ bool DS18B20_DS2482::isParasitePowerMode(void){
 // note if device is not connected it will fail writing the data.
 void DS18B20_DS2482::setUserData(uint8_t* deviceAddress, int16_t data)
 {
+    // one CRC checked read for the comparison and the bytes written back
+    ScratchPad scratchPad;
+    if (!isConnected(deviceAddress, scratchPad)) return;
+
     // return when stored value == new value
-    if(getUserData(deviceAddress) == data) return;
+    if (((scratchPad[HIGH_ALARM_TEMP] << 8) | scratchPad[LOW_ALARM_TEMP]) == (uint16_t)data) return;
 
-    ScratchPad scratchPad;
-    if (isConnected(deviceAddress, scratchPad))
-    {
-        scratchPad[HIGH_ALARM_TEMP] = data >> 8;
-        scratchPad[LOW_ALARM_TEMP] = data & 255;
-        writeScratchPad(deviceAddress, scratchPad);
-    }
+    scratchPad[HIGH_ALARM_TEMP] = data >> 8;
+    scratchPad[LOW_ALARM_TEMP] = data & 255;
+    writeScratchPad(deviceAddress, scratchPad);
 }
 
 int16_t DS18B20_DS2482::getUserData(uint8_t* deviceAddress)
@@ -554,6 +791,88 @@ void DS18B20_DS2482::setUserDataByIndex(uint8_t deviceIndex, int16_t data)
 }
 
 
+// sets the alarm thresholds, the configuration register is written back
+// from the cached resolution so the scratchpad does not have to be read first
+bool DS18B20_DS2482::setAlarmThresholds(uint8_t* deviceAddress, int8_t low, int8_t high, bool persist){
+
+    ScratchPad scratchPad;
+
+    switch (cachedResolution(deviceAddress)){
+    case 12:
+        scratchPad[CONFIGURATION] = TEMP_12_BIT;
+        break;
+    case 11:
+        scratchPad[CONFIGURATION] = TEMP_11_BIT;
+        break;
+    case 10:
+        scratchPad[CONFIGURATION] = TEMP_10_BIT;
+        break;
+    case 9:
+        scratchPad[CONFIGURATION] = TEMP_9_BIT;
+        break;
+    default:
+        return false; // not connected
+    }
+
+    scratchPad[HIGH_ALARM_TEMP] = (uint8_t)high;
+    scratchPad[LOW_ALARM_TEMP] = (uint8_t)low;
+    writeScratchPad(deviceAddress, scratchPad, persist);
+    return true;
+
+}
+
+// returns the high alarm threshold or DEVICE_DISCONNECTED_C
+int8_t DS18B20_DS2482::getHighAlarmTemp(uint8_t* deviceAddress){
+
+    ScratchPad scratchPad;
+    if (isConnected(deviceAddress, scratchPad)) return (int8_t)scratchPad[HIGH_ALARM_TEMP];
+    return DEVICE_DISCONNECTED_C;
+
+}
+
+// returns the low alarm threshold or DEVICE_DISCONNECTED_C
+int8_t DS18B20_DS2482::getLowAlarmTemp(uint8_t* deviceAddress){
+
+    ScratchPad scratchPad;
+    if (isConnected(deviceAddress, scratchPad)) return (int8_t)scratchPad[LOW_ALARM_TEMP];
+    return DEVICE_DISCONNECTED_C;
+
+}
+
+// compares the last conversion with the thresholds the same way the sensor does,
+// on the whole degrees
+bool DS18B20_DS2482::hasAlarm(uint8_t* deviceAddress){
+
+    ScratchPad scratchPad;
+    if (!isConnected(deviceAddress, scratchPad)) return false;
+
+    int8_t temp = calculateTemperature(deviceAddress, scratchPad) >> 7;
+    return temp >= (int8_t)scratchPad[HIGH_ALARM_TEMP] || temp <= (int8_t)scratchPad[LOW_ALARM_TEMP];
+
+}
+
+void DS18B20_DS2482::resetAlarmSearch(void){
+    alarmChannel = 0;
+    _wire->wireResetSearch();
+}
+
+// one alarm search per channel with sensors, in turn
+bool DS18B20_DS2482::alarmSearch(uint8_t* deviceAddress){
+
+    for (; alarmChannel < 8; alarmChannel++){
+
+        if (!(channelMask & (1 << alarmChannel))) continue;
+
+        _wire->useChannel(alarmChannel);
+        while (_wire->wireSearch(deviceAddress, WIRE_ALARM_SEARCH)){
+            if (validAddress(deviceAddress) && validFamily(deviceAddress)) return true;
+        }
+        _wire->wireResetSearch();
+    }
+    return false;
+
+}
+
 // Convert float Celsius to Fahrenheit
 float DS18B20_DS2482::toFahrenheit(float celsius){
     return (celsius * 1.8) + 32;
@@ -585,3 +904,55 @@ float DS18B20_DS2482::rawToFahrenheit(int16_t raw){
 
 }
 
+// convert from raw to a decimal string without floating point
+uint8_t DS18B20_DS2482::rawToString(int16_t raw, char* buffer, uint8_t decimals, uint8_t unit){
+
+    int32_t value;      // temperature in 1/scale degrees
+    uint16_t scale;
+    uint32_t whole, power = 1;
+    uint8_t i, length = 0;
+    char digits[10];
+
+    if (decimals > 4) decimals = 4;
+
+    if (unit == TEMP_FAHRENHEIT){
+        // F = RAW*9/640 + 32
+        scale = 640;
+        if (raw <= DEVICE_DISCONNECTED_RAW) value = (int32_t)(DEVICE_DISCONNECTED_F * 640);
+        else value = (int32_t)raw * 9 + 32L * 640;
+    }
+    else {
+        scale = 128;
+        if (raw <= DEVICE_DISCONNECTED_RAW) value = (int32_t)DEVICE_DISCONNECTED_C * 128;
+        else value = raw;
+    }
+
+    if (value < 0){
+        buffer[length++] = '-';
+        value = -value;
+    }
+
+    for (i = 0; i < decimals; i++) power *= 10;
+
+    // round half up at the last decimal
+    whole = ((uint32_t)value * power + scale / 2) / scale;
+
+    // decimals first, then the integer part, in reverse
+    i = 0;
+    while (i < decimals){
+        digits[i++] = '0' + whole % 10;
+        whole /= 10;
+    }
+    if (decimals > 0) digits[i++] = '.';
+    do {
+        digits[i++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+
+    while (i > 0) buffer[length++] = digits[--i];
+    buffer[length] = 0;
+
+    return length;
+
+}
+
@@ -49,6 +49,20 @@
 #define DEVICE_DISCONNECTED_F -196.6
 #define DEVICE_DISCONNECTED_RAW -7040
 
+// Temperature reads, see setReadMode()
+#define READ_FULL  0 // all 9 scratchpad bytes, checked with the CRC
+#define READ_SHORT 1 // the 2 temperature bytes, checked against the last reading
+
+// largest change from the last reading a short read accepts, 2 C in 1/128 C
+#define PLAUSIBLE_STEP 256
+
+// Units for rawToString()
+#define TEMP_CELSIUS    0
+#define TEMP_FAHRENHEIT 1
+
+// buffer size for rawToString(), "-1234.5678" and the terminator
+#define TEMP_STRING_LENGTH 12
+
 typedef uint8_t DeviceAddress[8];
 
 class DS18B20_DS2482
@@ -61,8 +75,19 @@ public:
     void setOneWire(DS2482*);
 
     // initialise bus
+    // uses the device list of the DS2482 (searching the bus if it is empty)
+    // and caches the resolution and power mode of every sensor that does
+    // not have them in its DeviceInfo yet
     void begin(void);
 
+    // searches the bus for the supported families only, with a targeted
+    // search per family, updates the DS2482 device list and begin()s again,
+    // returns the number of sensors that answered
+    uint8_t rescan(void);
+
+    // reads resolution and power mode of a listed device into its DeviceInfo entry
+    bool updateDeviceInfo(uint8_t*);
+
     // returns the number of devices found on the bus
     uint8_t getDeviceCount(void);
 
@@ -72,7 +97,7 @@ public:
     // returns true if address is of the family of sensors the lib supports.
     bool validFamily(uint8_t* deviceAddress);
 
-    // finds an address at a given index on the bus
+    // finds the address of the temperature sensor at a given index
     bool getAddress(uint8_t*, uint8_t);
 
     // attempt to determine if the device at the given address is connected to the bus
@@ -82,11 +107,11 @@ public:
     // also allows for updating the read scratchpad
     bool isConnected(uint8_t*, uint8_t*);
 
-    // read device's scratchpad
-    bool readScratchPad(uint8_t*, uint8_t*);
+    // read device's scratchpad, the first length bytes
+    bool readScratchPad(uint8_t*, uint8_t*, uint8_t length = 9);
 
-    // write device's scratchpad
-    void writeScratchPad(uint8_t*, uint8_t*);
+    // write device's scratchpad, and copy it to the EEPROM unless told not to
+    void writeScratchPad(uint8_t*, uint8_t*, bool copyToEeprom = true);
 
     // read device's power requirements
     bool readPowerSupply(uint8_t*);
@@ -120,9 +145,48 @@ public:
     // sends command for one device to perform a temperature conversion by index
     bool requestTemperaturesByIndex(uint8_t);
 
+    // non-blocking conversion, the caller sleeps or does other work and then
+    // asks isReady() / poll() if the results can be read
+    // starts a conversion on all devices, on every channel that has sensors, and returns immediately
+    // returns the worst case number of milliseconds until it is complete, 0 if no device answered
+    int16_t startConversion(void);
+
+    // starts a conversion on one device and returns immediately
+    // returns the worst case number of milliseconds until it is complete, 0 if disconnected
+    int16_t startConversionByAddress(uint8_t*);
+
+    // returns true while a started conversion has not completed
+    bool isConversionPending(void);
+
+    // asks the bus if the pending conversion has completed early
+    // (only if checkForConversion is set and the devices are not parasite powered)
+    // returns true once the conversion results can be read
+    bool poll(void);
+
+    // as poll(), deadline is set by the caller once the time returned
+    // by startConversion() has passed and the conversion is complete for sure
+    bool isReady(bool deadline);
+
+    // sets/gets the read mode of getTemp() with a last reading, READ_FULL
+    // or READ_SHORT. A short read has no CRC, so it is only taken when it is
+    // within step of the last reading, anything else is read again in full.
+    // Call it with READ_FULL from time to time to check every sensor.
+    void setReadMode(uint8_t mode, int16_t step = PLAUSIBLE_STEP);
+    uint8_t getReadMode(void);
+
     // returns temperature raw value (12 bit integer of 1/128 degrees C)
     int16_t getTemp(uint8_t*);
 
+    // as getTemp(), with the last reading of the device for a short read,
+    // DEVICE_DISCONNECTED_RAW if there is none
+    int16_t getTemp(uint8_t*, int16_t last);
+
+    // getTemp() with a last reading for one sensor on each of several
+    // bridges, read together with DS2482::transfer(): last holds the last
+    // readings and gets the new ones. At most one sensor per bridge and
+    // MAXBRIDGES in all.
+    static void getTemps(DS18B20_DS2482** sensors, uint8_t** addresses, int16_t* last, uint8_t count);
+
     // returns temperature in degrees C
     float getTempC(uint8_t*);
 
@@ -153,6 +217,23 @@ public:
     int16_t getUserData(uint8_t* );
     int16_t getUserDataByIndex(uint8_t );
 
+    // alarm thresholds in whole degrees C, a sensor has an alarm condition
+    // once a conversion gives a temperature <= low or >= high. They share
+    // the scratchpad bytes with the user data. persist copies them to the
+    // EEPROM, without it they only last until the next power up but each
+    // write spares the EEPROM and its 10 ms copy.
+    bool setAlarmThresholds(uint8_t*, int8_t low, int8_t high, bool persist = false);
+    int8_t getHighAlarmTemp(uint8_t*);
+    int8_t getLowAlarmTemp(uint8_t*);
+
+    // returns true if the sensor had an alarm condition at its last conversion
+    bool hasAlarm(uint8_t*);
+
+    // walk the sensors with an alarm condition with one alarm search,
+    // alarmSearch() returns false once every one has been found
+    void resetAlarmSearch(void);
+    bool alarmSearch(uint8_t*);
+
     // convert from Celsius to Fahrenheit
     static float toFahrenheit(float);
 
@@ -165,6 +246,12 @@ public:
     // convert from raw to Fahrenheit
     static float rawToFahrenheit(int16_t);
 
+    // convert from raw to a decimal string in integer arithmetic, rounded
+    // exactly half up to 0-4 decimals, where print(float) can round a half
+    // down. It calls no float code.
+    // buffer must hold TEMP_STRING_LENGTH bytes, returns the string length
+    static uint8_t rawToString(int16_t raw, char* buffer, uint8_t decimals = 2, uint8_t unit = TEMP_CELSIUS);
+
 private:
     typedef uint8_t ScratchPad[9];
 
@@ -181,6 +268,25 @@ private:
     // used to requestTemperature to dynamically check if a conversion is complete
     bool checkForConversion;
 
+    // a conversion has been started and not completed yet
+    bool conversionPending;
+
+    // READ_FULL or READ_SHORT, and the change a short read accepts
+    uint8_t readMode;
+    int16_t plausibleStep;
+
+    // the pending conversion involves parasite powered devices, the bus cannot be polled
+    bool conversionParasite;
+
+    // the pending conversion was started on every channel by startConversion()
+    bool conversionBroadcast;
+
+    // bit per DS2482-800 channel with sensors, set by begin()
+    uint8_t channelMask;
+
+    // channel of the alarm search in progress
+    uint8_t alarmChannel;
+
     // count of devices on the bus
     uint8_t devices;
 
@@ -190,19 +296,16 @@ private:
     // reads scratchpad and returns the raw temperature
     int16_t calculateTemperature(uint8_t*, uint8_t*);
 
-    void	blockTillConversionComplete(uint8_t);
-
-#if REQUIRESALARMS
+    // a short read will do for this device and last reading
+    bool shortRead(uint8_t*, int16_t last);
 
-    // required for alarmSearch
-    uint8_t alarmSearchAddress[8];
-    char alarmSearchJunction;
-    uint8_t alarmSearchExhausted;
+    // a short read is taken as the temperature
+    bool plausible(uint8_t*, int16_t raw, int16_t last);
 
-    // the alarm handler function pointer
-    AlarmHandler *_AlarmHandler;
+    // returns the cached resolution of a device, reading it if unknown
+    uint8_t cachedResolution(uint8_t*);
 
-#endif
+    void	blockTillConversionComplete(int16_t);
 
 };
 #endif
\ No newline at end of file
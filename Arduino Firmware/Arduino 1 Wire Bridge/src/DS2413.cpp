@@ -38,22 +38,47 @@ void DS2413::setOneWire(DS2482* _DS2482){
     DS2413_devices = 0;
 }
 
-// initialise the bus
+// count the switches in the DS2482 device list
 void DS2413::begin(void){
 
-    DeviceAddress deviceAddress;
-
-    _wire->wireResetSearch();
     DS2413_devices = 0; // Reset the number of devices when we enumerate wire devices
 
-    while (_wire->wireSearch(deviceAddress)){
+    for (uint8_t i = 0; i < _wire->getDeviceCount(); i++){
+
+        DeviceAddress& address = _wire->getDeviceAtIndex(i);
+
+        if (validFamily(address)){
+
+            DeviceInfo& info = _wire->getDeviceInfoAtIndex(i);
+
+            info.flags |= DEVICE_RESUME;
+
+            // a PIO read with its complement check shows the switch answers
+            // at overdrive, a list loaded from the EEPROM has the result.
+            // A switch that answers only at standard speed is probed once,
+            // one that does not answer at all is left for the next begin()
+            if (!(info.flags & DEVICE_PROBED)){
+                info.flags |= DEVICE_OVERDRIVE | DEVICE_PROBED;
+                if (readPIOState(address) < 0){
+                    info.flags &= ~DEVICE_OVERDRIVE;
+                    _wire->clearResume(); // it never took the overdrive ROM
+                    if (readPIOState(address) < 0) info.flags &= ~DEVICE_PROBED;
+                }
+            }
 
-        if (validAddress(deviceAddress) && validFamily(deviceAddress)){
             DS2413_devices++;
         }
     }
 }
 
+uint8_t DS2413::rescan(void){
+
+    uint8_t count = _wire->rescanFamily(DS2413MODEL);
+    begin();
+    return count;
+
+}
+
 // returns the number of devices found on the bus
 uint8_t DS2413::getDeviceCount(void){
     return DS2413_devices;
@@ -64,42 +89,74 @@ bool DS2413::validAddress(uint8_t* deviceAddress){
     return (_wire->crc8(deviceAddress, 7) == deviceAddress[7]);
 }
 
-// finds an address at a given index on the bus
+// finds the address of the device at a given index among the devices
+// of the families this library supports, from the DS2482 device list
 // returns true if the device was found
 bool DS2413::getAddress(uint8_t* deviceAddress, uint8_t index){
 
-    uint8_t depth = 0;
+    for (uint8_t i = 0; i < _wire->getDeviceCount(); i++){
 
-    _wire->wireResetSearch();
+        DeviceAddress& address = _wire->getDeviceAtIndex(i);
 
-    while (depth <= index && _wire->wireSearch(deviceAddress)) {
-        if (depth == index && validAddress(deviceAddress)) return true;
-        depth++;
+        if (validFamily(address) && index-- == 0){
+            for (uint8_t j = 0; j < 8; j++) deviceAddress[j] = address[j];
+            return true;
+        }
     }
 
     return false;
+
 }
 
 int DS2413::getPIOState(uint8_t* deviceAddress){
-    int b = _wire->reset();
-    if (b == 0) return -1;
 
-    _wire->wireSelect(deviceAddress);
-    //_wire->wireWriteByte(SKIPROM);
+    int state = readPIOState(deviceAddress);
+    DeviceInfo* info;
+    uint8_t overdrive;
+
+    // no answer: the switch may have been power cycled and forgotten that
+    // it was selected, or the read was hit by noise, so try once more at
+    // standard speed without Resume. Overdrive is a property of the part,
+    // the next read uses it again.
+    if (state < 0 && (info = _wire->getDeviceInfo(deviceAddress)) != NULL){
+        overdrive = info->flags & DEVICE_OVERDRIVE;
+        info->flags &= ~DEVICE_OVERDRIVE;
+        _wire->clearResume();
+        state = readPIOState(deviceAddress);
+        info->flags |= overdrive;
+    }
+    return state;
+
+}
+
+// two switches answering a Skip ROM would fail the complement check
+int DS2413::readPIOState(uint8_t* deviceAddress){
+    if (!_wire->select(deviceAddress, true)) return -1;
+
+    // no reset after the read, the next one ends it, so a switch read
+    // again straight away is still at overdrive for the Resume. The
+    // bridge idles at overdrive between polls and keeps it through an
+    // MCU reset, setup() clears that with DS2482::deviceReset()
     _wire->wireWriteByte(PIOACCESSREAD);
     uint8_t reg = _wire->wireReadByte();
-    _wire->reset();
+
+    // the upper nibble is the complement of the lower one
+    if ((((reg >> 4) ^ reg) & 0x0F) != 0x0F) return -1;
     return reg;
 }
 
+// the data byte is followed by its inverse, the switch answers 0xAA and
+// the new PIO status if both arrived intact
 int DS2413::setPIOState(uint8_t* deviceAddress, uint8_t state){
-    int b = _wire->reset();
-    if (b == 0) return -1;
+    if (!_wire->select(deviceAddress)) return -1;
 
-    _wire->wireSelect(deviceAddress);
-    //_wire->wireWriteByte(SKIPROM);
+    state |= 0xFC; // the unused bits are sent as 1
     _wire->wireWriteByte(PIOACCESSWRITE);
     _wire->wireWriteByte(state);
-    _wire->reset();
-    return 0;
+    _wire->wireWriteByte(~state);
+    uint8_t confirm = _wire->wireReadByte();
+    uint8_t reg = _wire->wireReadByte();
+
+    if (confirm != 0xAA || (((reg >> 4) ^ reg) & 0x0F) != 0x0F) return -1;
+    return reg;
 }
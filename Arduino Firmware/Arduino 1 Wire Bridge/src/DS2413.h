@@ -42,9 +42,16 @@ public:
 
     void setOneWire(DS2482*);
 
-    // initialise bus
+    // count the switches in the DS2482 device list, searching the bus
+    // only if the list has not been built yet, and try each new switch
+    // once at overdrive speed
     void begin(void);
 
+    // searches the bus for switches only with a targeted search, updates
+    // the DS2482 device list and counts again, returns the number of
+    // switches that answered
+    uint8_t rescan(void);
+
     // returns the number of devices found on the bus
     uint8_t getDeviceCount(void);
 
@@ -54,16 +61,25 @@ public:
     // returns true if address is of the family of sensors the lib supports.
     bool validFamily(uint8_t* deviceAddress);
 
-    // finds an address at a given index on the bus
+    // finds the address of the switch at a given index
     bool getAddress(uint8_t* deviceAddress, uint8_t index);
 
-    // PIO control
+    // PIO control, returns the PIO status byte or -1 if the device
+    // did not answer or the status failed its complement check. A switch
+    // with DEVICE_OVERDRIVE is read at overdrive speed. A failed read is
+    // tried once more at standard speed without Resume, DEVICE_OVERDRIVE
+    // is kept for the next read.
     int getPIOState(uint8_t* deviceAddress);
 
+    // sets the PIO output latches, bit 0 PIOA and bit 1 PIOB, returns the
+    // PIO status byte or -1 if the switch did not confirm the write
     int setPIOState(uint8_t* deviceAddress, uint8_t state);
 
 private:
 
+    // one PIO read at the speed of the device
+    int readPIOState(uint8_t* deviceAddress);
+
     // count of devices on the bus
     uint8_t DS2413_devices;
 
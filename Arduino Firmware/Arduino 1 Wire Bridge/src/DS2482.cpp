@@ -26,41 +26,99 @@
 #include "Arduino.h"  // according http://blog.makezine.com/2011/12/01/arduino-1-0-is-out-heres-what-you-need-to-know/
 
 #include "DS2482.h"
-#include "Wire.h"
+#include "TwiTransport.h"
+#include <avr/eeprom.h>
+#if TWI_ASYNC && defined(__AVR__)
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#endif
 
 
 #define PTR_STATUS 0xf0
 #define PTR_READ 0xe1
 #define PTR_CONFIG 0xc3
+#define PTR_CHANNEL 0xd2
 
-DS2482::DS2482(uint8_t addr)
+// 1-Wire command durations in microseconds at standard / overdrive speed
+#define T_RESET_STD 1148
+#define T_RESET_OD 146
+#define T_SLOT_STD 69
+#define T_SLOT_OD 11
+
+DS2482::DS2482(uint8_t addr, uint8_t channels)
 {
 	mAddress = 0x18 | addr;	
+	mChannels = channels;
+	mChannel = 0xFF;	// unknown, a DS2482-800 keeps its channel through an MCU reset
+	mTimeout = 0;
+	mConfig = 0;
+	mReadPtr = 0;		// unknown until the first set read pointer
+	mBusy = true;		// the line may be busy until the first status read
+	mBusyTime = 0;
+	mResumable = false;
+	mDeviceCount = 0;
+	mDeviceTotal = 0;
+	mDeviceListValid = false;
+	mScanRemoved = 0;
+	wireResetSearch();
+	restartScan();
+#if DS2482_STATS
+	resetStats();
+#endif
 }
 
 //-------helpers
 void DS2482::begin()
 {
-	Wire.beginTransmission(mAddress);
+	mTxLength = 0;
 }
 
 void DS2482::end()
 {
-	Wire.endTransmission();
+#if DS2482_STATS
+	unsigned long start = micros();
+	TwiTransport::write(mAddress, mTx, mTxLength);
+	mStats.writeTime += micros() - start;
+	mStats.transactions++;
+#else
+	TwiTransport::write(mAddress, mTx, mTxLength);
+#endif
 }
 
+void DS2482::writeByte(uint8_t data)
+{
+	if (mTxLength < sizeof(mTx))
+		mTx[mTxLength++] = data;
+#if DS2482_STATS
+	mStats.bytes++;
+#endif
+}
+
+// the read pointer is tracked so it is only sent when it has to change
 void DS2482::setReadPtr(uint8_t readPtr)
 {
+	if (readPtr == mReadPtr)
+		return;
+	mReadPtr = readPtr;
 	begin();
-	Wire.write(0xe1);  // changed from 'send' to 'write' according http://blog.makezine.com/2011/12/01/arduino-1-0-is-out-heres-what-you-need-to-know/'
-	Wire.write(readPtr);     
+	writeByte(0xe1);  // changed from 'send' to 'write' according http://blog.makezine.com/2011/12/01/arduino-1-0-is-out-heres-what-you-need-to-know/'
+	writeByte(readPtr);     
 	end();
 }
 
 uint8_t DS2482::readByte()
 {
-	Wire.requestFrom(mAddress,(uint8_t)1);
-	return Wire.read();  
+	uint8_t data = 0xff;	// what Wire returned for a read that got nothing
+#if DS2482_STATS
+	unsigned long start = micros();
+	TwiTransport::read(mAddress, &data, 1);
+	mStats.readTime += micros() - start;
+	mStats.transactions++;
+	mStats.bytes++;
+#else
+	TwiTransport::read(mAddress, &data, 1);
+#endif
+	return data;
 }
 
 uint8_t DS2482::wireReadStatus(bool setPtr)
@@ -71,19 +129,65 @@ uint8_t DS2482::wireReadStatus(bool setPtr)
 	return readByte();
 }
 
+// a 1-Wire command has been sent, the DS2482 points the read pointer at the
+// status register and is busy for about the given number of microseconds
+void DS2482::setBusy(uint16_t time)
+{
+	mReadPtr = PTR_STATUS;
+	mBusy = true;
+	mBusyTime = time;
+	mBusyStart = micros();
+}
+
+// expected duration of the given number of 1-Wire time slots at the current speed
+uint16_t DS2482::slotTime(uint8_t slots)
+{
+	return slots * (mConfig & DS2484_CONFIG_WS ? T_SLOT_OD : T_SLOT_STD);
+}
+
+// waits for the previous 1-Wire command before a new command is sent,
+// only reads the status if a command is still outstanding
+void DS2482::waitIdle()
+{
+	if (mBusy)
+		busyWait(true);
+}
+
 uint8_t DS2482::busyWait(bool setReadPtr)
 {
 	uint8_t status;
 	int loopCount = 1000;
+#if DS2482_STATS
+	unsigned long start = micros();
+#endif
+	// sleep until the outstanding command should be complete
+	if (mBusy && mBusyTime)
+	{
+		unsigned long elapsed = micros() - mBusyStart;
+		if (elapsed < mBusyTime)
+			delayMicroseconds(mBusyTime - elapsed);
+	}
+
 	while((status = wireReadStatus(setReadPtr)) & DS2482_STATUS_BUSY)
 	{
+#if DS2482_STATS
+		mStats.busyPolls++;
+#endif
 		if (--loopCount <= 0)
 		{
 			mTimeout = 1;
+#if DS2482_STATS
+			mStats.timeouts++;
+#endif
 			break;
 		}
-		delayMicroseconds(20);
+		delayMicroseconds(slotTime(1));
 	}
+	if (!(status & DS2482_STATUS_BUSY))
+		mBusy = false;
+#if DS2482_STATS
+	mStats.busyTime += micros() - start;
+#endif
 	return status;
 }
 
@@ -93,14 +197,138 @@ uint8_t DS2482::reset()
 	return wireReset();
 }
 
+uint8_t DS2482::reset(uint8_t *addr)
+{
+	DeviceInfo *info;
+
+	if (mChannels > 1 && (info = getDeviceInfo(addr)) != NULL)
+		useChannel(info->channel);
+	return wireReset();
+}
+
+bool DS2482::select(uint8_t *addr, bool allowSkip)
+{
+	DeviceInfo *info = getDeviceInfo(addr);
+	uint8_t command = romCommand(addr, allowSkip);
+	bool overdrive = info != NULL && (info->flags & DEVICE_OVERDRIVE);
+
+	// every other reset returns to standard speed, so a bridge still at
+	// overdrive means the device has not left it since its last transaction.
+	// The speed is the bridge's, not the channel's: after a channel switch
+	// reset(addr) goes back to the device's line at standard speed
+	if (command == 0xa5 && overdrive && isOverdrive() && (mChannels == 1 || info->channel == mChannel))
+	{
+		startReset();
+		if (!wirePresence())
+			return false;
+	}
+	else if (!reset(addr))
+		return false;
+
+	switch (command)
+	{
+		case 0xa5:
+			wireWriteByte(0xa5);
+			break;
+		case 0xcc:
+			if (!overdrive)
+			{
+				wireSkip();
+				break;
+			}
+			wireWriteByte(0x3c);	// Overdrive Skip
+			setOverdrive(true);
+			mResumable = false;
+			break;
+		default:
+			if (overdrive)
+				wireOverdriveSelect(addr);
+			else
+				wireSelect(addr);
+			break;
+	}
+	return true;
+}
+
+// Resume (0xa5), Skip ROM (0xcc) or Match ROM (0x55) for a listed device,
+// see select()
+uint8_t DS2482::romCommand(uint8_t *addr, bool allowSkip)
+{
+	DeviceInfo *info = getDeviceInfo(addr);
+
+	if (info == NULL)
+		return 0x55;
+	if ((info->flags & DEVICE_RESUME) && mResumable && memcmp(addr, mSelected, sizeof(DeviceAddress)) == 0)
+		return 0xa5;
+	if (allowSkip && channelDevices(info->channel) == 1)
+		return 0xcc;
+	return 0x55;
+}
+
+// listed devices on a channel, missing ones included as they may come
+// back, 0xFF if the bus holds devices the list has no room for
+uint8_t DS2482::channelDevices(uint8_t channel)
+{
+	uint8_t count = 0;
+
+	if (mDeviceTotal > mDeviceCount)
+		return 0xFF;
+	for (uint8_t i = 0; i < mDeviceCount; i++)
+		if (DeviceInfoList[i].channel == channel)
+			count++;
+	return count;
+}
+
+bool DS2482::useChannel(uint8_t channel)
+{
+	if (mChannels == 1 || channel == mChannel)
+		return true;
+	return selectChannel(channel);
+}
+
+// accepted even while a 1-Wire command runs, it ends the command
+bool DS2482::deviceReset()
+{
+	begin();
+	writeByte(0xf0);
+	end();
+	mReadPtr = PTR_STATUS;
+	mResumable = false;
+
+	if (readByte() & DS2482_STATUS_RST)
+	{
+		mConfig = 0;
+		mChannel = 0;
+		mBusy = false;
+		return true;
+	}
+
+	mChannel = 0xFF;
+	mBusy = true;
+	mBusyTime = 0;
+	return configure(0);
+}
+
 bool DS2482::configure(uint8_t config)
 {
-	busyWait(true);
+	waitIdle();
 	begin();
-	Wire.write(0xd2);    
-	Wire.write(config | (~config)<<4);   
+	writeByte(0xd2);    
+	writeByte(config | (~config)<<4);   
+	end();
+	mReadPtr = PTR_CONFIG;
 
-	return readByte() == config;
+	mConfig = readByte();
+	return mConfig == config;
+}
+
+bool DS2482::setOverdrive(bool overdrive)
+{
+	uint8_t config = overdrive ? mConfig | DS2484_CONFIG_WS : mConfig & ~DS2484_CONFIG_WS;
+
+	if (config == mConfig)
+		return true;
+	return configure(config);
 }
 
 bool DS2482::selectChannel(uint8_t channel)
@@ -144,26 +372,57 @@ bool DS2482::selectChannel(uint8_t channel)
 			break;
 	};
 
-	busyWait(true);
+	waitIdle();
 	begin();
-	Wire.write(0xc3);  
-	Wire.write(ch); 
+	writeByte(0xc3);  
+	writeByte(ch); 
 	end();
-	busyWait();
+	mReadPtr = PTR_CHANNEL;
 	
 	uint8_t check = readByte();
-	
+
+	mChannel = check == ch_read ? channel : 0xFF;
 	return check == ch_read;
 }
 
 bool DS2482::wireReset()
 {
-	busyWait(true);
+	wireStartReset();
+	return wirePresence();
+}
+
+void DS2482::wireStartReset()
+{
+	// an overdrive reset would only reach the devices left at overdrive
+	setOverdrive(false);
+	startReset();
+}
+
+void DS2482::startReset()
+{
+#if DS2482_STATS
+	unsigned long start = micros();
+#endif
+	waitIdle();
 	begin();
-	Wire.write(0xb4); 
+	writeByte(0xb4); 
 	end();
-	
+	setBusy(mConfig & DS2484_CONFIG_WS ? T_RESET_OD : T_RESET_STD);
+#if DS2482_STATS
+	mStats.resetTime += micros() - start;
+	mStats.resets++;
+#endif
+}
+
+bool DS2482::wirePresence()
+{
+#if DS2482_STATS
+	unsigned long start = micros();
+#endif
 	uint8_t status = busyWait();
+#if DS2482_STATS
+	mStats.resetTime += micros() - start;
+#endif
 	
 	return status & DS2482_STATUS_PPD ? true : false;
 }
@@ -171,19 +430,31 @@ bool DS2482::wireReset()
 
 void DS2482::wireWriteByte(uint8_t b)
 {
-	busyWait(true);
+	waitIdle();
 	begin();
-	Wire.write(0xa5);  
-	Wire.write(b); 
+	writeByte(0xa5);  
+	writeByte(b); 
 	end();
+	setBusy(slotTime(8));
 }
 
 uint8_t DS2482::wireReadByte()
 {
-	busyWait(true);
+	wireStartRead();
+	return wireReadResult();
+}
+
+void DS2482::wireStartRead()
+{
+	waitIdle();
 	begin();
-	Wire.write(0x96);  
+	writeByte(0x96);  
 	end();
+	setBusy(slotTime(8));
+}
+
+uint8_t DS2482::wireReadResult()
+{
 	busyWait();
 	setReadPtr(PTR_READ);
 	return readByte();
@@ -191,11 +462,12 @@ uint8_t DS2482::wireReadByte()
 
 void DS2482::wireWriteBit(uint8_t bit)
 {
-	busyWait(true);
+	waitIdle();
 	begin();
-	Wire.write(0x87); 
-	Wire.write(bit ? 0x80 : 0);
+	writeByte(0x87); 
+	writeByte(bit ? 0x80 : 0);
 	end();
+	setBusy(slotTime(1));
 }
 
 uint8_t DS2482::wireReadBit()
@@ -205,9 +477,23 @@ uint8_t DS2482::wireReadBit()
 	return status & DS2482_STATUS_SBR ? 1 : 0;
 }
 
+// one search step: reads a bit and its complement and writes the
+// direction taken, a single status poll returns all three
+uint8_t DS2482::wireTriplet(uint8_t direction)
+{
+	waitIdle();
+	begin();
+	writeByte(0x78); 
+	writeByte(direction ? 0x80 : 0);
+	end();
+	setBusy(slotTime(3));
+	return busyWait();
+}
+
 void DS2482::wireSkip()
 {
 	wireWriteByte(0xcc);
+	mResumable = false;
 }
 
 void DS2482::wireSelect(uint8_t rom[8])
@@ -215,18 +501,437 @@ void DS2482::wireSelect(uint8_t rom[8])
 	wireWriteByte(0x55);
 	for (int i=0;i<8;i++)
 		wireWriteByte(rom[i]);
+	memcpy(mSelected, rom, sizeof(DeviceAddress));
+	mResumable = true;
+}
+
+#if TWI_ASYNC
+// phases of a transfer() job
+#define JOB_RESET	0
+#define JOB_ROM		1
+#define JOB_TX		2
+#define JOB_RX		3
+#define JOB_END		4	// trailing reset, left running
+#define JOB_DONE	5
+
+// I2C transfers of one 1-Wire command
+#define JOB_ISSUE	0	// the command
+#define JOB_POLL	1	// status reads until the line is idle
+#define JOB_POINTER	2	// read pointer to the data register
+#define JOB_DATA	3	// the byte read
+#define JOB_FAILED	4	// NACK or timeout, the bridge state is unknown
+
+static DS2482 *jobBridges[MAXBRIDGES];
+static uint8_t jobCount;
+static volatile uint8_t jobCurrent;
+static volatile bool jobRunning = false;
+
+#ifdef __AVR__
+static void (*jobTimerHandler)(void);
+
+// Timer2 compare A ends a wait for the 1-Wire lines
+ISR(TIMER2_COMPA_vect)
+{
+	TCCR2B = 0;
+	TIMSK2 = 0;
+	jobTimerHandler();
+}
+#else
+static uint16_t jobDelay;
+#endif
+
+// no I2C transfer runs to raise the TWI interrupt, every bridge waits
+// for its line: Timer2 raises one when the first wait is over. clk/128
+// counts 8 us at 16 MHz, the 8 bits reach past a standard speed reset
+static void jobWake(uint16_t us)
+{
+#ifdef __AVR__
+	uint32_t ticks = ((uint32_t)us * (F_CPU / 1000000UL) + 127) / 128;
+
+	TCCR2B = 0;
+	TCCR2A = _BV(WGM21);	// CTC, a match every OCR2A + 1 counts
+	TCNT2 = 0;
+	OCR2A = ticks > 256 ? 255 : ticks - 1;
+	TIFR2 = _BV(OCF2A);
+	TIMSK2 = _BV(OCIE2A);
+	TCCR2B = _BV(CS22) | _BV(CS20);
+#else
+	jobDelay = us;
+#endif
+}
+
+// the steps of the lockstep version below become a queue per bridge,
+// worked through one I2C transfer at a time from the TWI interrupt
+void DS2482::transfer(WireTransfer *transfers, uint8_t count)
+{
+	WireTransfer *t;
+	DeviceInfo *info;
+	DS2482 *bridge;
+
+	jobCount = 0;
+	for (t = transfers; t < transfers + count; t++)
+	{
+		bridge = t->bridge;
+		if (t->address != NULL && bridge->mChannels > 1 && (info = bridge->getDeviceInfo(t->address)) != NULL)
+			bridge->useChannel(info->channel);
+		bridge->setOverdrive(false);
+		bridge->waitIdle();
+		t->present = false;
+		t->command = t->address != NULL ? bridge->romCommand(t->address, t->allowSkip) : 0xcc;
+		bridge->mJob = t;
+		bridge->mJobPhase = JOB_RESET;
+		bridge->mJobIndex = 0;
+		bridge->mJobState = JOB_ISSUE;
+		bridge->mJobPolls = 0;
+		jobBridges[jobCount++] = bridge;
+	}
+
+	jobCurrent = jobCount - 1;
+	jobRunning = true;
+	TwiTransport::onComplete(jobComplete);
+#ifdef __AVR__
+	jobTimerHandler = jobSchedule;
+#else
+	jobDelay = 0;
+#endif
+	jobSchedule();
+	while (jobRunning)
+	{
+#ifdef __AVR__
+		// idle sleep until the TWI or the Timer2 interrupt, checked with
+		// interrupts off so the last one is not missed
+		cli();
+		if (jobRunning)
+		{
+			set_sleep_mode(SLEEP_MODE_IDLE);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
+#else
+		// the synchronous transport is done with a transfer once it starts,
+		// and a wait for the lines is spent as busyWait() spends it
+		if (jobDelay)
+		{
+			delayMicroseconds(jobDelay);
+			jobDelay = 0;
+			jobSchedule();
+		}
+		else
+			jobComplete();
+#endif
+	}
+
+	for (t = transfers; t < transfers + count; t++)
+	{
+		t->bridge->endJob();
+		if (!t->present || t->command == 0xa5)
+			continue;
+		if (t->command == 0x55)
+			memcpy(t->bridge->mSelected, t->address, sizeof(DeviceAddress));
+		t->bridge->mResumable = t->command == 0x55;
+	}
+}
+
+// the bridge whose I2C transfer is over takes its result, then the next
+// one with work left starts a transfer, so a bridge waiting for its
+// 1-Wire line lets the others have the I2C bus
+void DS2482::jobComplete()
+{
+	if (!jobRunning)
+		return;
+	jobBridges[jobCurrent]->jobResult();
+	jobSchedule();
+}
+
+void DS2482::jobSchedule()
+{
+	uint8_t next;
+	uint16_t wait, soonest = 0;
+
+	for (uint8_t i = 1; i <= jobCount; i++)
+	{
+		next = (jobCurrent + i) % jobCount;
+		if ((wait = jobBridges[next]->jobWait()) != 0)
+		{
+			if (soonest == 0 || wait < soonest)
+				soonest = wait;
+			continue;
+		}
+		if (jobBridges[next]->jobNext())
+		{
+			jobCurrent = next;
+			return;
+		}
+	}
+	if (soonest)
+		jobWake(soonest);
+	else
+		jobRunning = false;
+}
+
+// 1-Wire bytes in the current phase
+uint8_t DS2482::jobLength()
+{
+	switch (mJobPhase)
+	{
+		case JOB_ROM:
+			return mJob->command == 0x55 ? 9 : 1;
+		case JOB_TX:
+			return mJob->txLength;
+		case JOB_RX:
+			return mJob->rxLength;
+		default:
+			return 1;
+	}
+}
+
+// next 1-Wire command, past the phases with nothing to send
+void DS2482::jobAdvance()
+{
+	mJobState = JOB_ISSUE;
+	mJobPolls = 0;
+	if (++mJobIndex < jobLength())
+		return;
+	mJobIndex = 0;
+	while (++mJobPhase < JOB_DONE && jobLength() == 0)
+		;
+}
+
+// microseconds until the first status poll is worth sending, 0 if it is
+// due or the next I2C transfer is not a poll
+uint16_t DS2482::jobWait()
+{
+	unsigned long elapsed;
+
+	if (mJobPhase == JOB_DONE || mJobState != JOB_POLL || mJobPolls > 0)
+		return 0;
+	elapsed = micros() - mBusyStart;
+	return elapsed < mBusyTime ? mBusyTime - elapsed : 0;
+}
+
+// starts the next I2C transfer of the job, false once it is over
+bool DS2482::jobNext()
+{
+	uint8_t length = 1;
+
+	if (mJobPhase == JOB_DONE)
+		return false;
+	switch (mJobState)
+	{
+		case JOB_ISSUE:
+			switch (mJobPhase)
+			{
+				case JOB_RESET:
+				case JOB_END:
+					mJobBuffer[0] = 0xb4;
+#if DS2482_STATS
+					mStats.resets++;
+#endif
+					break;
+				case JOB_RX:
+					mJobBuffer[0] = 0x96;
+					break;
+				default:
+					mJobBuffer[0] = 0xa5;
+					if (mJobPhase == JOB_TX)
+						mJobBuffer[1] = mJob->tx[mJobIndex];
+					else
+						mJobBuffer[1] = mJobIndex == 0 ? mJob->command : mJob->address[mJobIndex - 1];
+					length = 2;
+					break;
+			}
+			break;
+		case JOB_POINTER:
+			mJobBuffer[0] = 0xe1;
+			mJobBuffer[1] = PTR_READ;
+			length = 2;
+			break;
+		default:
+#if DS2482_STATS
+			mStats.transactions++;
+			mStats.bytes++;
+#endif
+			return TwiTransport::startRead(mAddress, mJobBuffer, 1);
+	}
+#if DS2482_STATS
+	mStats.transactions++;
+	mStats.bytes += length;
+#endif
+	return TwiTransport::startWrite(mAddress, mJobBuffer, length);
+}
+
+// takes the result of the transfer started by jobNext()
+void DS2482::jobResult()
+{
+	if (TwiTransport::failed())
+	{
+		mJobState = JOB_FAILED;
+		mJobPhase = JOB_DONE;
+		return;
+	}
+	switch (mJobState)
+	{
+		case JOB_ISSUE:
+			if (mJobPhase == JOB_END)
+				mJobPhase = JOB_DONE;
+			else
+			{
+				// the bridge runs at standard speed for the whole job
+				setBusy(mJobPhase == JOB_RESET ? T_RESET_STD : slotTime(8));
+				mJobState = JOB_POLL;
+			}
+			break;
+		case JOB_POLL:
+			if (mJobBuffer[0] & DS2482_STATUS_BUSY)
+			{
+#if DS2482_STATS
+				mStats.busyPolls++;
+#endif
+				if (++mJobPolls >= 1000)
+				{
+					mTimeout = 1;
+#if DS2482_STATS
+					mStats.timeouts++;
+#endif
+					mJobState = JOB_FAILED;
+					mJobPhase = JOB_DONE;
+				}
+				break;
+			}
+			if (mJobPhase == JOB_RX)
+				mJobState = JOB_POINTER;
+			else if (mJobPhase == JOB_RESET && !(mJobBuffer[0] & DS2482_STATUS_PPD))
+				mJobPhase = JOB_DONE;
+			else
+			{
+				if (mJobPhase == JOB_RESET)
+					mJob->present = true;
+				jobAdvance();
+			}
+			break;
+		case JOB_POINTER:
+			mJobState = JOB_DATA;
+			break;
+		case JOB_DATA:
+			mJob->rx[mJobIndex] = mJobBuffer[0];
+			jobAdvance();
+			break;
+	}
+}
+
+// what the bridge was left doing, for the calls after transfer()
+void DS2482::endJob()
+{
+	if (mJobState == JOB_FAILED)
+	{
+		mReadPtr = 0;
+		mBusy = true;
+		mBusyTime = 0;
+	}
+	else if (mJob->present)
+		setBusy(T_RESET_STD);
+	else
+	{
+		mReadPtr = PTR_STATUS;
+		mBusy = false;
+	}
+}
+#else
+// a write only waits for the previous byte on its own bridge, so the
+// loops over the bridges keep every one of them busy
+void DS2482::transfer(WireTransfer *transfers, uint8_t count)
+{
+	WireTransfer *t;
+	DeviceInfo *info;
+	uint8_t most = 0;
+
+	for (t = transfers; t < transfers + count; t++)
+	{
+		if (t->address != NULL && t->bridge->mChannels > 1 && (info = t->bridge->getDeviceInfo(t->address)) != NULL)
+			t->bridge->useChannel(info->channel);
+		t->bridge->wireStartReset();
+	}
+	for (t = transfers; t < transfers + count; t++)
+		t->present = t->bridge->wirePresence();
+
+	// ROM command, then the ROM for a Match ROM, as one run of writes
+	for (t = transfers; t < transfers + count; t++)
+		if (t->present)
+			t->bridge->wireWriteByte(t->command = t->address != NULL ? t->bridge->romCommand(t->address, t->allowSkip) : 0xcc);
+	for (uint8_t i = 0; i < 8; i++)
+		for (t = transfers; t < transfers + count; t++)
+			if (t->present && t->command == 0x55)
+				t->bridge->wireWriteByte(t->address[i]);
+	for (t = transfers; t < transfers + count; t++)
+	{
+		if (!t->present || t->command == 0xa5)
+			continue;
+		if (t->command == 0x55)
+			memcpy(t->bridge->mSelected, t->address, sizeof(DeviceAddress));
+		t->bridge->mResumable = t->command == 0x55;
+	}
+
+	for (t = transfers; t < transfers + count; t++)
+		if (t->present && t->txLength > most) most = t->txLength;
+	for (uint8_t i = 0; i < most; i++)
+		for (t = transfers; t < transfers + count; t++)
+			if (t->present && i < t->txLength)
+				t->bridge->wireWriteByte(t->tx[i]);
+
+	most = 0;
+	for (t = transfers; t < transfers + count; t++)
+		if (t->present && t->rxLength > most) most = t->rxLength;
+	for (uint8_t i = 0; i < most; i++)
+	{
+		for (t = transfers; t < transfers + count; t++)
+			if (t->present && i < t->rxLength)
+				t->bridge->wireStartRead();
+		for (t = transfers; t < transfers + count; t++)
+			if (t->present && i < t->rxLength)
+				t->rx[i] = t->bridge->wireReadResult();
+	}
+
+	for (t = transfers; t < transfers + count; t++)
+		if (t->present)
+			t->bridge->wireStartReset();
+}
+#endif
+
+// the devices switch speed after the command byte, the bridge with them
+void DS2482::wireOverdriveSelect(uint8_t rom[8])
+{
+	wireWriteByte(0x69);
+	setOverdrive(true);
+	for (int i=0;i<8;i++)
+		wireWriteByte(rom[i]);
+	memcpy(mSelected, rom, sizeof(DeviceAddress));
+	mResumable = true;
 }
 
 void DS2482::wireResetSearch()
 {
 	searchExhausted = 0;
 	searchLastDisrepancy = 0;
+	searchFamily = 0;
 	
 	for(uint8_t i = 0; i<8; i++) 
 		searchAddress[i] = 0;
 }
 
-uint8_t DS2482::wireSearch(uint8_t *newAddr)
+// the last discrepancy at 64 replays the preset family bits on the first
+// pass and takes the 0 branch everywhere after them
+void DS2482::wireTargetSearch(uint8_t family)
+{
+	wireResetSearch();
+	searchAddress[0] = family;
+	searchLastDisrepancy = 64;
+	searchFamily = family;
+}
+
+uint8_t DS2482::wireSearch(uint8_t *newAddr, uint8_t command)
 {
 	uint8_t i;
 	uint8_t direction;
@@ -238,8 +943,8 @@ uint8_t DS2482::wireSearch(uint8_t *newAddr)
 	if (!wireReset()) 
 		return 0;
 
-	busyWait(true);
-	wireWriteByte(0xf0);
+	wireWriteByte(command);
+	mResumable = false;	// the devices that drop out forget being selected
 	
 	for(i=1;i<65;i++) 
 	{
@@ -251,12 +956,7 @@ uint8_t DS2482::wireSearch(uint8_t *newAddr)
 		else
 			direction = i == searchLastDisrepancy;
 		
-		busyWait();
-		begin();
-		Wire.write(0x78); 
-		Wire.write(direction ? 0x80 : 0);
-		end();
-		uint8_t status = busyWait();
+		uint8_t status = wireTriplet(direction);
 		
 		uint8_t id = status & DS2482_STATUS_SBR;
 		uint8_t comp_id = status & DS2482_STATUS_TSB;
@@ -280,6 +980,13 @@ uint8_t DS2482::wireSearch(uint8_t *newAddr)
 
 	if (last_zero == 0) 
 		searchExhausted = 1;
+
+	// past the last device of the target family
+	if (searchFamily && searchAddress[0] != searchFamily)
+	{
+		searchExhausted = 1;
+		return 0;
+	}
 	
 	for (i=0;i<8;i++) 
 		newAddr[i] = searchAddress[i];
@@ -291,23 +998,377 @@ DeviceAddress& DS2482::getDeviceAtIndex(uint8_t index){
 	return DeviceList[index];
 }
 
+DeviceInfo& DS2482::getDeviceInfoAtIndex(uint8_t index){
+	return DeviceInfoList[index];
+}
+
+DeviceInfo* DS2482::getDeviceInfo(uint8_t *addr){
+	int8_t index = getDeviceIndex(addr);
+	if (index < 0)
+		return NULL;
+	return &DeviceInfoList[index];
+}
+
+int8_t DS2482::getDeviceIndex(uint8_t *addr){
+	for (uint8_t i = 0; i < mDeviceCount; i++){
+		uint8_t j = 0;
+		while (j < 8 && DeviceList[i][j] == addr[j])
+			j++;
+		if (j == 8)
+			return i;
+	}
+	return -1;
+}
+
 uint8_t DS2482::devicesCount(bool printAddress){
   DeviceAddress address;
   uint8_t count = 0;
+  uint8_t pos;
 
-  wireResetSearch();
-  while (wireSearch(address)){   
+  for (uint8_t channel = 0; channel < mChannels; channel++){
+	useChannel(channel);
+	wireResetSearch();
+	while (wireSearch(address)){   
 
-	if (count < MAXDEVICES){
-		for (int i=0; i < 8; i++){
-			DeviceList[count][i] = address[i];
-		}
-	}    
-	count++;
+		// garbage from a noisy bus
+		if (crc8(address, 7) != address[7])
+			continue;
+
+		if (count < MAXDEVICES){
+			// insert after the last device of the same or a lower family on this channel
+			pos = count;
+			while (pos > 0 && DeviceInfoList[pos - 1].channel == channel && DeviceList[pos - 1][0] > address[0]){
+				memcpy(DeviceList[pos], DeviceList[pos - 1], sizeof(DeviceAddress));
+				DeviceInfoList[pos] = DeviceInfoList[pos - 1];
+				pos--;
+			}
+			for (int i=0; i < 8; i++){
+				DeviceList[pos][i] = address[i];
+			}
+			DeviceInfoList[pos].family = address[0];
+			DeviceInfoList[pos].channel = channel;
+			DeviceInfoList[pos].resolution = 0;
+			DeviceInfoList[pos].flags = 0;
+			DeviceInfoList[pos].conversionTime = 0;
+		}    
+		count++;
+	}
   }
+  mDeviceCount = count < MAXDEVICES ? count : MAXDEVICES;
+  mDeviceTotal = count;
+  mDeviceListValid = true;
+  mScanRemoved = 0;
+  restartScan();
   return count;
 }
 
+uint8_t DS2482::getDeviceCount(){
+	if (!mDeviceListValid)
+		devicesCount(false);
+	return mDeviceCount;
+}
+
+bool DS2482::getAddress(uint8_t *addr, uint8_t index){
+	uint8_t i;
+
+	if (!mDeviceListValid)
+		devicesCount(false);
+
+	if (index >= mDeviceTotal)
+		return false;
+
+	if (index < MAXDEVICES){
+		for (i = 0; i < 8; i++)
+			addr[i] = DeviceList[index][i];
+		return true;
+	}
+
+	// not kept in the list, walk the search
+	i = 0;
+	for (uint8_t channel = 0; channel < mChannels; channel++){
+		useChannel(channel);
+		wireResetSearch();
+		while (wireSearch(addr)){
+			if (crc8(addr, 7) != addr[7])
+				continue;
+			if (i++ == index)
+				return true;
+		}
+	}
+	return false;
+}
+
+// magic, count, ROM and DeviceInfo of every device, CRC-16 little endian
+void DS2482::saveDeviceList(uint16_t eeprom){
+	uint8_t header[2] = { DEVICE_LIST_MAGIC, mDeviceCount };
+	uint8_t *p = (uint8_t *)(uintptr_t)eeprom;
+	uint16_t crc;
+
+	crc = crc16(header, sizeof(header));
+	eeprom_update_block(header, p, sizeof(header));
+	p += sizeof(header);
+
+	for (uint8_t i = 0; i < mDeviceCount; i++){
+		crc = crc16(DeviceList[i], sizeof(DeviceAddress), crc);
+		eeprom_update_block(DeviceList[i], p, sizeof(DeviceAddress));
+		p += sizeof(DeviceAddress);
+
+		crc = crc16((uint8_t *)&DeviceInfoList[i], sizeof(DeviceInfo), crc);
+		eeprom_update_block(&DeviceInfoList[i], p, sizeof(DeviceInfo));
+		p += sizeof(DeviceInfo);
+	}
+
+	eeprom_update_block(&crc, p, sizeof(crc));
+}
+
+bool DS2482::loadDeviceList(uint16_t eeprom){
+	uint8_t header[2];
+	uint8_t *p = (uint8_t *)(uintptr_t)eeprom;
+	uint16_t crc;
+	uint16_t stored;
+
+	eeprom_read_block(header, p, sizeof(header));
+	if (header[0] != DEVICE_LIST_MAGIC || header[1] > MAXDEVICES)
+		return false;
+	crc = crc16(header, sizeof(header));
+	p += sizeof(header);
+
+	for (uint8_t i = 0; i < header[1]; i++){
+		eeprom_read_block(DeviceList[i], p, sizeof(DeviceAddress));
+		crc = crc16(DeviceList[i], sizeof(DeviceAddress), crc);
+		p += sizeof(DeviceAddress);
+
+		eeprom_read_block(&DeviceInfoList[i], p, sizeof(DeviceInfo));
+		crc = crc16((uint8_t *)&DeviceInfoList[i], sizeof(DeviceInfo), crc);
+		p += sizeof(DeviceInfo);
+	}
+
+	eeprom_read_block(&stored, p, sizeof(stored));
+	if (stored != crc){
+		mDeviceListValid = false;
+		return false;
+	}
+
+	mDeviceCount = header[1];
+	mDeviceTotal = header[1];
+	mDeviceListValid = true;
+	mScanRemoved = 0;
+	restartScan();
+	return true;
+}
+
+bool DS2482::verifyDeviceList(){
+	DeviceAddress address;
+	uint8_t count = 0;
+
+	int8_t slot;
+
+	for (uint8_t channel = 0; channel < mChannels; channel++){
+		useChannel(channel);
+		wireResetSearch();
+		while (wireSearch(address)){
+			if (crc8(address, 7) != address[7])
+				return false;
+			slot = getDeviceIndex(address);
+			if (slot < 0 || DeviceInfoList[slot].channel != channel)
+				return false;
+			// saved while it was missing, it answers again
+			DeviceInfoList[slot].flags &= ~(DEVICE_MISSING | DEVICE_PROBED);
+			count++;
+		}
+	}
+	return count == mDeviceTotal;
+}
+
+uint8_t DS2482::rescanFamily(uint8_t family){
+	DeviceAddress address;
+	uint32_t seen = 0;
+	uint8_t count = 0;
+	int8_t slot;
+
+	if (!mDeviceListValid)
+		devicesCount(false);
+
+	for (uint8_t channel = 0; channel < mChannels; channel++){
+		useChannel(channel);
+		wireTargetSearch(family);
+		while (wireSearch(address)){
+			if (crc8(address, 7) != address[7])
+				continue;
+			count++;
+
+			slot = getDeviceIndex(address);
+			if (slot < 0)
+				slot = addDevice(address, channel);
+			if (slot >= 0){
+				seen |= 1UL << slot;
+				DeviceInfoList[slot].channel = channel;
+				if (DeviceInfoList[slot].flags & DEVICE_MISSING)
+					DeviceInfoList[slot].flags &= ~(DEVICE_MISSING | DEVICE_PROBED);
+			}
+		}
+	}
+
+	for (uint8_t i = 0; i < mDeviceCount; i++){
+		if (DeviceList[i][0] == family && !(seen & (1UL << i)))
+			DeviceInfoList[i].flags |= DEVICE_MISSING;
+	}
+
+	// the background round has the news already
+	mScanRemoved &= ~seen;
+	return count;
+}
+
+uint8_t DS2482::rediscover(uint8_t *index){
+	DeviceAddress address;
+	uint8_t found;
+	uint8_t exhausted;
+	int8_t slot;
+	bool added;
+
+	// removals from the last round, one per call
+	if (mScanRemoved){
+		for (slot = 0; !(mScanRemoved & (1UL << slot)); slot++);
+		mScanRemoved &= ~(1UL << slot);
+		DeviceInfoList[slot].flags |= DEVICE_MISSING;
+		*index = slot;
+		return DEVICE_REMOVED;
+	}
+
+	useChannel(scanChannel);
+	swapSearch();
+	found = wireSearch(address);
+	exhausted = searchExhausted;
+	swapSearch();
+
+	if (!found){
+		// nobody answered at the start of the walk, the channel is empty,
+		// later on a device left in the middle of the walk: try again
+		if (mScanFirst)
+			nextScanChannel();
+		else
+			restartScanWalk();
+		return 0;
+	}
+	mScanFirst = false;
+
+	added = false;
+	if (crc8(address, 7) == address[7]){
+		slot = getDeviceIndex(address);
+		if (slot < 0){
+			slot = addDevice(address, scanChannel);
+			added = slot >= 0;
+		}
+		if (slot >= 0){
+			mScanSeen |= 1UL << slot;
+			// back after going missing, its driver probes it again
+			if (DeviceInfoList[slot].flags & DEVICE_MISSING){
+				DeviceInfoList[slot].flags &= ~(DEVICE_MISSING | DEVICE_PROBED);
+				added = true;
+			}
+			// moved to another channel
+			if (DeviceInfoList[slot].channel != scanChannel){
+				DeviceInfoList[slot].channel = scanChannel;
+				added = true;
+			}
+			*index = slot;
+		}
+	}
+
+	if (exhausted)
+		nextScanChannel();
+
+	return added ? DEVICE_ADDED : 0;
+}
+
+void DS2482::swapSearch(){
+	uint8_t t;
+
+	for (uint8_t i = 0; i < 8; i++){
+		t = searchAddress[i];
+		searchAddress[i] = scanAddress[i];
+		scanAddress[i] = t;
+	}
+	t = searchLastDisrepancy;
+	searchLastDisrepancy = scanLastDisrepancy;
+	scanLastDisrepancy = t;
+	t = searchExhausted;
+	searchExhausted = scanExhausted;
+	scanExhausted = t;
+	t = searchFamily;
+	searchFamily = scanFamily;
+	scanFamily = t;
+}
+
+void DS2482::restartScan(){
+	restartScanWalk();
+	scanChannel = 0;
+	mScanSeen = 0;
+}
+
+void DS2482::restartScanWalk(){
+	for (uint8_t i = 0; i < 8; i++)
+		scanAddress[i] = 0;
+	scanLastDisrepancy = 0;
+	scanExhausted = 0;
+	scanFamily = 0;
+	mScanFirst = true;
+}
+
+// the walk of a channel is complete, the round once every channel is
+void DS2482::nextScanChannel(){
+	restartScanWalk();
+	if (++scanChannel == mChannels)
+		endScan();
+}
+
+// the round is complete, whatever was not seen has gone
+void DS2482::endScan(){
+	for (uint8_t i = 0; i < mDeviceCount; i++){
+		if (!(mScanSeen & (1UL << i)) && !(DeviceInfoList[i].flags & DEVICE_MISSING))
+			mScanRemoved |= 1UL << i;
+	}
+	restartScan();
+}
+
+// append, or reuse the slot of a missing device when the list is full
+int8_t DS2482::addDevice(uint8_t *addr, uint8_t channel){
+	uint8_t pos;
+
+	if (mDeviceCount < MAXDEVICES){
+		pos = mDeviceCount++;
+		if (mDeviceTotal < mDeviceCount)
+			mDeviceTotal = mDeviceCount;
+	}
+	else {
+		pos = 0;
+		while (pos < MAXDEVICES && !(DeviceInfoList[pos].flags & DEVICE_MISSING))
+			pos++;
+		if (pos == MAXDEVICES)
+			return -1;
+		mScanRemoved &= ~(1UL << pos);
+	}
+
+	memcpy(DeviceList[pos], addr, sizeof(DeviceAddress));
+	DeviceInfoList[pos].family = addr[0];
+	DeviceInfoList[pos].channel = channel;
+	DeviceInfoList[pos].resolution = 0;
+	DeviceInfoList[pos].flags = 0;
+	DeviceInfoList[pos].conversionTime = 0;
+	return pos;
+}
+
+#if DS2482_STATS
+const DS2482Stats& DS2482::getStats(){
+	return mStats;
+}
+
+void DS2482::resetStats(){
+	memset(&mStats, 0, sizeof(mStats));
+	mTimeout = 0;
+}
+#endif
+
 uint8_t DS2482::crc8( uint8_t *addr, uint8_t len)
 {
 	uint8_t crc=0;
@@ -328,5 +1389,21 @@ uint8_t DS2482::crc8( uint8_t *addr, uint8_t len)
 	return crc;
 }
 
+uint16_t DS2482::crc16(const uint8_t *input, uint16_t len, uint16_t crc)
+{
+	for (uint16_t i=0; i<len; i++)
+	{
+		crc ^= input[i];
+		for (uint8_t j=0; j<8; j++)
+		{
+			if (crc & 0x01)
+				crc = (crc >> 1) ^ 0xA001;
+			else
+				crc >>= 1;
+		}
+	}
+	return crc;
+}
+
 // tools
 #define getString(type) (String)#type
\ No newline at end of file
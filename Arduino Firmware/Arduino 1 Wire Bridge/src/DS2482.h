@@ -20,6 +20,7 @@
 #define __DS2482_H__
 
 #include <inttypes.h>
+#include "TwiTransport.h"
 
 #define DS2482_CONFIG_APU (1<<0)
 #define DS2482_CONFIG_PPM (1<<1)
@@ -35,39 +36,186 @@
 #define DS2482_STATUS_TSB	(1<<6)
 #define DS2482_STATUS_DIR	(1<<7)
 
+// list entries per bridge, lower it to fit several bridges in the RAM
+// and EEPROM of an ATmega328 (build_flags = -D MAXDEVICES=8)
+#ifndef MAXDEVICES
 #define MAXDEVICES 20
+#endif
+
+// the rediscovery and report masks hold a bit per list index in a uint32_t
+static_assert(MAXDEVICES <= 32, "MAXDEVICES is limited to 32 by the uint32_t device bitmasks");
+
+// DS2482 chips on one I2C bus, address 0-3 from the AD1 AD0 pins
+#define MAXBRIDGES 4
+
+// saveDeviceList() format, bump when DeviceInfo changes
+#define DEVICE_LIST_MAGIC 0xD2
+
+// ROM commands for wireSearch()
+#define WIRE_SEARCH_ROM   0xF0	// every device
+#define WIRE_ALARM_SEARCH 0xEC	// only devices with an alarm condition
+
+// Set to 1 (build_flags = -D DS2482_STATS=1) to count I2C transactions,
+// busy polls, 1-Wire resets and timeouts and the time spent in each primitive
+#ifndef DS2482_STATS
+#define DS2482_STATS 0
+#endif
+
+// DeviceInfo flags
+#define DEVICE_PARASITE	(1<<0)	// device is powered from the data line
+#define DEVICE_MISSING	(1<<1)	// not found by the last rediscovery round
+#define DEVICE_OVERDRIVE	(1<<2)	// answers at overdrive speed, see select()
+#define DEVICE_PROBED	(1<<3)	// overdrive tried by its driver, DEVICE_OVERDRIVE holds the result, cleared when a missing device returns
+#define DEVICE_RESUME	(1<<4)	// takes the Resume command, set by its driver
+
+// rediscover() events
+#define DEVICE_ADDED	1	// new device, or a missing one answered again
+#define DEVICE_REMOVED	2	// device no longer answers the search
 
 typedef uint8_t DeviceAddress[8];
 
+// Per device metadata, filled once at enumeration so the drivers
+// do not have to ask the device again on every access
+typedef struct
+{
+	uint8_t family;			// first ROM byte
+	uint8_t channel;		// DS2482-800 channel of the device, 0 on a DS2482-100
+	uint8_t resolution;		// temperature resolution in bits, 0 if unknown
+	uint8_t flags;			// DEVICE_* flags
+	uint16_t conversionTime;	// milliseconds to wait for a conversion
+} DeviceInfo;
+
+// EEPROM bytes taken by saveDeviceList() with a full list, the next
+// bridge can keep its list at the address after it
+#define DEVICE_LIST_BYTES (2 + MAXDEVICES * (sizeof(DeviceAddress) + sizeof(DeviceInfo)) + 2)
+
+class DS2482;
+
+// One 1-Wire transaction for DS2482::transfer(): a reset, the ROM command
+// select() would use for address and allowSkip (Overdrive aside) or Skip
+// ROM if it is NULL, the tx bytes, then rxLength bytes read into rx
+typedef struct
+{
+	DS2482 *bridge;
+	uint8_t *address;		// listed device, its channel is selected first
+	const uint8_t *tx;
+	uint8_t txLength;
+	uint8_t *rx;
+	uint8_t rxLength;
+	bool allowSkip;			// as for select()
+	bool present;			// set by transfer(), a device answered the reset
+	uint8_t command;		// set by transfer(), the ROM command sent
+} WireTransfer;
+
+#if DS2482_STATS
+// Bus statistics since the last resetStats(), times in microseconds
+typedef struct
+{
+	uint16_t transactions;	// I2C transactions, writes and reads
+	uint16_t bytes;			// I2C bytes, without the address
+	uint16_t busyPolls;		// status reads that found the 1-Wire line busy
+	uint16_t resets;		// 1-Wire resets
+	uint16_t timeouts;		// busyWait() gave up waiting
+	uint32_t writeTime;		// I2C writes
+	uint32_t readTime;		// I2C reads
+	uint32_t busyTime;		// busyWait()
+	uint32_t resetTime;		// wireReset()
+} DS2482Stats;
+#endif
+
 class DS2482
 {
 public:
 
 
-	//Address is 0-3
-	DS2482(uint8_t address);    
+	//Address is 0-3, channels is 1 for a DS2482-100 or 8 for a DS2482-800
+	DS2482(uint8_t address, uint8_t channels = 1);    
 	
 	bool configure(uint8_t config);
+
+	// DS2482 Device Reset, back to the power up state: standard speed,
+	// channel 0, line idle. The chip keeps its state through an MCU
+	// reset, so call this before anything else at boot. If the chip
+	// does not report the reset, the configuration is written instead
+	// and the channel is left unknown. Returns false if neither worked.
+	bool deviceReset();
+
+	// 1-Wire speed, the 1WS bit of the configuration, only written when it
+	// changes. Every reset is sent at standard speed, which also returns
+	// the devices to standard speed, so overdrive lasts one transaction.
+	bool setOverdrive(bool overdrive);
+	bool isOverdrive() { return mConfig & DS2484_CONFIG_WS; }
+
 	uint8_t reset();
+
+	// 1-Wire reset on the channel of a listed device, ahead of wireSelect()
+	uint8_t reset(uint8_t *addr);
+
+	// Reset and select a listed device with the shortest ROM command:
+	//  - Resume if it has DEVICE_RESUME and was the last device selected,
+	//    after an overdrive reset if it was left at overdrive
+	//  - Skip ROM if allowSkip and it is the only listed device on its
+	//    channel
+	//  - otherwise Match ROM
+	// A device plugged in since the last search takes a Skip ROM too, so
+	// allowSkip is only for commands where that does no harm: reads whose
+	// answer the caller checks with a CRC or complement, which a mix of
+	// two devices fails, and broadcasts such as Convert T. Never for a
+	// write. A device with DEVICE_OVERDRIVE gets Overdrive Skip or
+	// Overdrive Match instead, which leave the bridge at overdrive speed
+	// for the rest of the transaction. Returns false if no device
+	// answered the reset.
+	bool select(uint8_t *addr, bool allowSkip = false);
+
+	// the next select() sends the ROM again, for a device that may have
+	// lost track of being the last one selected (power cycled)
+	void clearResume() { mResumable = false; }
 	
 	//DS2482-800 only
 	bool selectChannel(uint8_t channel);
+
+	// selects the channel unless it is selected already, nothing to do
+	// on a DS2482-100
+	bool useChannel(uint8_t channel);
+	uint8_t getChannelCount() { return mChannels; }
 	
 	bool wireReset(); // return true if presence pulse is detected
+
+	// wireReset() in two halves, so other bridges can be given work while
+	// the reset runs: wireStartReset() returns once the command is sent,
+	// wirePresence() waits for the reset and returns the presence pulse
+	void wireStartReset();
+	bool wirePresence();
 	uint8_t wireReadStatus(bool setPtr=false);
 	
 	void wireWriteByte(uint8_t b);
 	uint8_t wireReadByte();
+
+	// wireReadByte() in two halves, as wireStartReset() / wirePresence()
+	void wireStartRead();
+	uint8_t wireReadResult();
 	
 	void wireWriteBit(uint8_t bit);
 	uint8_t wireReadBit();
+
+	// 1-Wire triplet for searches, returns the status register with the
+	// id bit (SBR), its complement (TSB) and the direction taken (DIR)
+	uint8_t wireTriplet(uint8_t direction);
     // Issue a 1-Wire rom select command, you do the reset first.
     void wireSelect( uint8_t rom[8]);
+	// Overdrive Match ROM at standard speed, then the ROM at overdrive speed
+	void wireOverdriveSelect(uint8_t rom[8]);
 	// Issue skip rom
 	void wireSkip();
 	
 	uint8_t hasTimeout() { return mTimeout; }
 
+#if DS2482_STATS
+	const DS2482Stats& getStats();
+	// clears the statistics and the timeout flag
+	void resetStats();
+#endif
+
     // Clear the search state so that if will start from the beginning again.
     void wireResetSearch();
 
@@ -76,31 +224,173 @@ public:
     // no devices, or you have already retrieved all of them.  It
     // might be a good idea to check the CRC to make sure you didn't
     // get garbage.  The order is deterministic. You will always get
-    // the same devices in the same order.
-    uint8_t wireSearch(uint8_t *newAddr);
+    // the same devices in the same order. command selects a normal
+    // search or an alarm search, reset the search before switching.
+    uint8_t wireSearch(uint8_t *newAddr, uint8_t command = WIRE_SEARCH_ROM);
+
+    // Set up the search to go straight to the devices of one family:
+    // wireSearch() then returns them one by one and returns 0 instead of
+    // the first device of another family. The search tree is ordered by
+    // the low ROM bits first, so a family is one branch of it and the
+    // other families are not walked. wireResetSearch() clears the target.
+    void wireTargetSearch(uint8_t family);
 
     DeviceAddress& getDeviceAtIndex(uint8_t index);
+    DeviceInfo& getDeviceInfoAtIndex(uint8_t index);
+
+    // Returns the metadata entry of a listed device or NULL if the
+    // address is not in the device list.
+    DeviceInfo* getDeviceInfo(uint8_t *addr);
+
+    // Returns the index of a listed device or -1 if the address is
+    // not in the device list.
+    int8_t getDeviceIndex(uint8_t *addr);
 
+    // Search the bus and rebuild the device list, returns the number of
+    // devices found (may be more than MAXDEVICES). Every channel of a
+    // DS2482-800 is searched in turn. ROMs that fail the CRC are dropped
+    // and the list is kept grouped by channel, so walking it switches
+    // channels as little as possible, then by family, in search order
+    // within a family, so a driver finds all of its devices together.
     uint8_t devicesCount(bool printAddress);
 
+    // Number of entries in the device list, searches the bus first if
+    // the list has not been built yet or has been invalidated.
+    uint8_t getDeviceCount();
+
+    // Copies the address of the device at index from the device list,
+    // searching the bus only if the list is invalid. Devices past
+    // MAXDEVICES are found with a search walk, in search order.
+    // Returns false if there is no device at index.
+    bool getAddress(uint8_t *addr, uint8_t index);
+
+    // The next getDeviceCount() / getAddress() will search the bus again.
+    void invalidateDeviceList() { mDeviceListValid = false; }
+
+    // Targeted search of one family against the device list: the devices
+    // found are added or lose DEVICE_MISSING, listed devices of the family
+    // that do not answer get DEVICE_MISSING. Other families are left
+    // alone. Returns the number of devices of the family found.
+    uint8_t rescanFamily(uint8_t family);
+
+    // The device list with its metadata in the AVR EEPROM at eeprom, so a
+    // warm boot can skip the enumeration: saveDeviceList() writes only the
+    // bytes that changed, loadDeviceList() returns false unless the EEPROM
+    // holds a list with a good CRC. Neither touches the bus.
+    void saveDeviceList(uint16_t eeprom = 0);
+    bool loadDeviceList(uint16_t eeprom = 0);
+
+    // One search walk, true if the bus holds exactly the listed devices,
+    // to check a loaded list for the cost of the search alone. A device
+    // saved as DEVICE_MISSING that answers loses the flag.
+    bool verifyDeviceList();
+
+    // Background rediscovery, one search pass (one device) per call with
+    // its own search state, so the device list follows hot plugging
+    // without a full devicesCount(). A round walks every channel. A new device is appended to the list,
+    // or takes the slot of a missing one once the list is full. A device
+    // not seen for a whole round is flagged DEVICE_MISSING but keeps its
+    // index, and gets it back when it answers again. Returns DEVICE_ADDED
+    // or DEVICE_REMOVED with the list index in *index, or 0.
+    uint8_t rediscover(uint8_t *index);
+
+    // Runs one transaction on each of count bridges in lockstep: every
+    // step is sent to all of them before the first is waited for, so the
+    // 1-Wire time of one chip overlaps the I2C traffic to the others. At
+    // most one transaction per bridge. The reset that ends each one is
+    // left running, the next command to the bridge waits for it.
+    // With TWI_ASYNC the transactions are a queue of 1-Wire commands run
+    // by the TWI interrupt, one I2C transfer at a time going round the
+    // bridges, and the CPU sleeps until the last one is over. Timer2 ends
+    // the waits for the 1-Wire lines. Everything else, select(), the
+    // searches and the drivers' own commands, waits on each transfer.
+    static void transfer(WireTransfer *transfers, uint8_t count);
+
     // Compute a Dallas Semiconductor 8 bit CRC, these are used in the
     // ROM and scratchpad registers.
     static uint8_t crc8(uint8_t *addr, uint8_t len);
 
+    // Compute the Dallas Semiconductor 16 bit CRC (CRC-16/ARC), continuing
+    // from crc so a block can be checked a piece at a time.
+    static uint16_t crc16(const uint8_t *input, uint16_t len, uint16_t crc = 0);
+
 private:
     DeviceAddress DeviceList[MAXDEVICES];
+    DeviceInfo DeviceInfoList[MAXDEVICES];
+    uint8_t mDeviceCount;
+    uint8_t mDeviceTotal;
+    bool mDeviceListValid;
 	uint8_t mAddress;
+	uint8_t mChannels;
+	uint8_t mChannel;			// selected channel, 0xFF if unknown
 	uint8_t mTimeout;
+	uint8_t mConfig;
+	uint8_t mReadPtr;			// register the read pointer is on
+	bool mBusy;					// a 1-Wire command may still be running
+	uint16_t mBusyTime;			// its expected duration in microseconds
+	unsigned long mBusyStart;
+	uint8_t mTx[2];				// I2C write from begin() to end()
+	uint8_t mTxLength;
 	uint8_t readByte();
+	void writeByte(uint8_t data);
 	void setReadPtr(uint8_t readPtr);
 	
 	uint8_t busyWait(bool setReadPtr=false); //blocks until
+	void waitIdle();
+	void setBusy(uint16_t time);
+	uint16_t slotTime(uint8_t slots);
 	void begin();
 	void end();
+	void startReset();
 	
+	// the last device a ROM command selected, for Resume
+	DeviceAddress mSelected;
+	bool mResumable;
+	uint8_t romCommand(uint8_t *addr, bool allowSkip);
+	uint8_t channelDevices(uint8_t channel);
+	
+#if TWI_ASYNC
+	// transfer() from the TWI interrupt, one I2C transfer per step
+	WireTransfer *mJob;
+	uint8_t mJobPhase;			// reset, ROM, tx, rx, trailing reset
+	uint8_t mJobIndex;			// byte within the phase
+	uint8_t mJobState;			// I2C transfer within the 1-Wire command
+	uint16_t mJobPolls;
+	uint8_t mJobBuffer[2];
+	uint8_t jobLength();
+	void jobAdvance();
+	uint16_t jobWait();
+	bool jobNext();
+	void jobResult();
+	void endJob();
+	static void jobComplete();
+	static void jobSchedule();
+#endif
+
 	uint8_t searchAddress[8];
 	uint8_t searchLastDisrepancy;
 	uint8_t searchExhausted;
+	uint8_t searchFamily;		// wireTargetSearch() family, 0 for any
+
+	// rediscover() walk, swapped with the search state above for each pass
+	uint8_t scanAddress[8];
+	uint8_t scanLastDisrepancy;
+	uint8_t scanExhausted;
+	uint8_t scanFamily;
+	uint8_t scanChannel;
+	bool mScanFirst;			// no pass on this channel has found a device yet
+	uint32_t mScanSeen;			// bit per list index found this round
+	uint32_t mScanRemoved;		// removals still to be returned
+	void swapSearch();
+	void restartScan();
+	void restartScanWalk();
+	void nextScanChannel();
+	void endScan();
+	int8_t addDevice(uint8_t *addr, uint8_t channel);
+
+#if DS2482_STATS
+	DS2482Stats mStats;
+#endif
 };
 
 
@@ -0,0 +1,64 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "FrameWriter.h"
+#include "DS2482.h"
+
+uint8_t FrameWriter::sBlock[COBS_BLOCK];
+
+FrameWriter::FrameWriter(Print &out) : mOut(out)
+{
+    mLength = 0;
+    mCrc = 0;
+}
+
+size_t FrameWriter::write(uint8_t c){
+
+    mCrc = DS2482::crc16(&c, 1, mCrc);
+    encode(c);
+    return 1;
+
+}
+
+void FrameWriter::writeInt16(int16_t value){
+
+    write((uint8_t)value);
+    write((uint8_t)(value >> 8));
+
+}
+
+void FrameWriter::end(){
+
+    uint16_t crc = mCrc;
+
+    encode((uint8_t)crc);
+    encode((uint8_t)(crc >> 8));
+    flushBlock(mLength + 1);
+    mOut.write((uint8_t)0);
+
+    mCrc = 0;
+
+}
+
+// a zero ends the block, the code byte in front of it gives its length
+void FrameWriter::encode(uint8_t c){
+
+    if (c == 0){
+        flushBlock(mLength + 1);
+        return;
+    }
+
+    sBlock[mLength++] = c;
+    if (mLength == COBS_BLOCK) flushBlock(COBS_BLOCK + 1);
+
+}
+
+void FrameWriter::flushBlock(uint8_t code){
+
+    mOut.write(code);
+    mOut.write(sBlock, mLength);
+    mLength = 0;
+
+}
@@ -0,0 +1,63 @@
+#ifndef FrameWriter_h
+#define FrameWriter_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Binary frame writer for the serial report.
+//
+// Bytes written to the frame are followed by end() with a CRC-16/ARC
+// of the payload, little endian, and the lot is COBS encoded on the
+// fly so the frame never contains a zero. A single zero byte ends the
+// frame, a host that loses sync skips to the next zero.
+//
+// The COBS block buffer is shared by every FrameWriter and kept out of
+// the stack, so only one frame can be open at a time: end() it before
+// the next FrameWriter writes.
+//
+//   FrameWriter frame(Serial);
+//   frame.write(type);
+//   frame.write(rom, 8);
+//   frame.writeInt16(raw);
+//   frame.end();
+
+#include <inttypes.h>
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define COBS_BLOCK 254 // longest run of non-zero bytes in a COBS block
+
+class FrameWriter : public Print
+{
+public:
+
+    FrameWriter(Print &out);
+
+    // int16 little endian
+    void writeInt16(int16_t value);
+
+    // appends the CRC, encodes the last block and sends the delimiter,
+    // the writer is then ready for the next frame
+    void end();
+
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+private:
+
+    Print &mOut;
+    static uint8_t sBlock[COBS_BLOCK];
+    uint8_t mLength;
+    uint16_t mCrc;
+
+    void encode(uint8_t c);
+    void flushBlock(uint8_t code);
+};
+
+#endif
@@ -0,0 +1,123 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "JsonWriter.h"
+
+JsonWriter::JsonWriter(Print &out) : mOut(out)
+{
+    mLength = 0;
+    mDepth = 0;
+    mElements = 0;
+    mAfterKey = false;
+}
+
+size_t JsonWriter::write(uint8_t c){
+
+    mBuffer[mLength++] = c;
+    if (mLength == JSON_BUFFER || c == '\n') flush();
+    return 1;
+
+}
+
+void JsonWriter::flush(){
+
+    if (mLength > 0) mOut.write((const uint8_t *)mBuffer, mLength);
+    mLength = 0;
+
+}
+
+// comma before every element but the first of its container
+void JsonWriter::separator(){
+
+    if (mAfterKey){
+        mAfterKey = false;
+        return;
+    }
+
+    if (mElements & (1 << mDepth)) write(',');
+    mElements |= (1 << mDepth);
+
+}
+
+void JsonWriter::open(const __FlashStringHelper *key, char c){
+
+    if (key != NULL) this->key(key);
+    separator();
+
+    write(c);
+
+    if (mDepth < JSON_DEPTH - 1) mDepth++;
+    mElements &= ~(1 << mDepth);
+
+}
+
+void JsonWriter::close(char c){
+
+    if (mDepth > 0) mDepth--;
+    write(c);
+
+}
+
+void JsonWriter::beginObject(const __FlashStringHelper *key){
+    open(key, '{');
+}
+
+void JsonWriter::endObject(){
+    close('}');
+}
+
+void JsonWriter::beginArray(const __FlashStringHelper *key){
+    open(key, '[');
+}
+
+void JsonWriter::endArray(){
+    close(']');
+}
+
+void JsonWriter::key(const __FlashStringHelper *key){
+
+    separator();
+    write('"');
+    print(key);
+    print(F("\": "));
+    mAfterKey = true;
+
+}
+
+void JsonWriter::beginString(const __FlashStringHelper *key){
+
+    if (key != NULL) this->key(key);
+    separator();
+    write('"');
+
+}
+
+void JsonWriter::endString(){
+    write('"');
+}
+
+void JsonWriter::number(const __FlashStringHelper *key, unsigned long value){
+
+    this->key(key);
+    separator();
+    print(value);
+
+}
+
+void JsonWriter::address(const __FlashStringHelper *key, const uint8_t *rom){
+
+    uint8_t nibble;
+
+    beginString(key);
+    for (uint8_t i = 0; i < 8; i++){
+        if (i > 0) write('-');
+        nibble = rom[i] >> 4;
+        write(nibble < 10 ? '0' + nibble : 'a' + nibble - 10);
+        nibble = rom[i] & 0x0F;
+        write(nibble < 10 ? '0' + nibble : 'a' + nibble - 10);
+    }
+    endString();
+
+}
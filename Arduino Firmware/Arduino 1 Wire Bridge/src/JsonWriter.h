@@ -0,0 +1,86 @@
+#ifndef JsonWriter_h
+#define JsonWriter_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// Streaming JSON writer for the serial report.
+//
+// Output goes through a small fixed buffer straight to a Print, keys
+// are taken from flash with F(), so a report needs no heap and no RAM
+// copy of the document. Commas are inserted automatically. Because the
+// writer is itself a Print, values can be printed with the usual
+// print() calls between beginString() and endString().
+//
+//   JsonWriter json(Serial);
+//   json.beginObject();
+//   json.beginArray(F("temperatures"));
+//   json.beginObject();
+//   json.address(F("address"), rom);
+//   json.beginString(F("value")); json.print(tempC); json.endString();
+//   json.endObject();
+//   json.endArray();
+//   json.endObject();
+//   json.println();   // flushes
+
+#include <inttypes.h>
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define JSON_BUFFER 32 // bytes held before they are passed to the Print
+#define JSON_DEPTH  8  // maximum nesting of objects and arrays
+
+class JsonWriter : public Print
+{
+public:
+
+    JsonWriter(Print &out);
+
+    // containers, key is NULL for an array element or the outer object
+    void beginObject(const __FlashStringHelper *key = NULL);
+    void endObject();
+    void beginArray(const __FlashStringHelper *key = NULL);
+    void endArray();
+
+    // "key": followed by a value written by the next call
+    void key(const __FlashStringHelper *key);
+
+    // "key": "  print the value, then endString() closes the quote
+    void beginString(const __FlashStringHelper *key = NULL);
+    void endString();
+
+    // "key": number
+    void number(const __FlashStringHelper *key, unsigned long value);
+
+    // "key": "28-68-4d-c4-0b-00-00-8f"
+    void address(const __FlashStringHelper *key, const uint8_t *rom);
+
+    // pass the buffered output on to the Print
+    void flush();
+
+    // a new line ends the report and is sent out straight away
+    virtual size_t write(uint8_t c);
+    using Print::write;
+
+private:
+
+    Print &mOut;
+    char mBuffer[JSON_BUFFER];
+    uint8_t mLength;
+
+    uint8_t mDepth;
+    uint8_t mElements; // bit per depth, set once that level has an element
+    bool mAfterKey;    // the next value belongs to the key just written
+
+    void separator();
+    void open(const __FlashStringHelper *key, char c);
+    void close(char c);
+};
+
+#endif
@@ -0,0 +1,180 @@
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+#include "TwiTransport.h"
+
+#if TWI_ASYNC && defined(__AVR__)
+
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+#define TWCR_NEXT (_BV(TWEN) | _BV(TWIE) | _BV(TWINT))
+
+static volatile uint8_t twiTarget;      // SLA+R or SLA+W
+static uint8_t * volatile twiData;
+static volatile uint8_t twiLength;
+static volatile uint8_t twiIndex;
+static volatile bool twiBusy = false;
+static volatile bool twiFailed = false;
+static void (* volatile twiHandler)(void) = NULL;
+
+void TwiTransport::begin(){
+
+    // internal pull-ups, as the Wire library sets them
+    digitalWrite(SDA, HIGH);
+    digitalWrite(SCL, HIGH);
+
+    TWSR = 0;   // prescaler 1
+    TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
+    TWCR = _BV(TWEN);
+
+}
+
+static bool start(uint8_t target, uint8_t *data, uint8_t length){
+
+    if (twiBusy) return false;
+
+    twiTarget = target;
+    twiData = data;
+    twiLength = length;
+    twiIndex = 0;
+    twiFailed = false;
+    twiBusy = true;
+    TWCR = TWCR_NEXT | _BV(TWSTA);
+    return true;
+
+}
+
+// the next transfer may be started from the handler, so the STOP has
+// to be on the bus first
+static void stop(bool failed){
+
+    TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);
+    while (TWCR & _BV(TWSTO));
+
+    twiFailed = failed;
+    twiBusy = false;
+    if (twiHandler != NULL) twiHandler();
+
+}
+
+ISR(TWI_vect){
+
+    switch (TW_STATUS){
+        case TW_START:
+        case TW_REP_START:
+            TWDR = twiTarget;
+            TWCR = TWCR_NEXT;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (twiIndex < twiLength){
+                TWDR = twiData[twiIndex++];
+                TWCR = TWCR_NEXT;
+            }
+            else stop(false);
+            break;
+
+        // acknowledge every byte but the last
+        case TW_MR_SLA_ACK:
+            TWCR = twiLength > 1 ? TWCR_NEXT | _BV(TWEA) : TWCR_NEXT;
+            break;
+        case TW_MR_DATA_ACK:
+            twiData[twiIndex++] = TWDR;
+            TWCR = twiIndex < twiLength - 1 ? TWCR_NEXT | _BV(TWEA) : TWCR_NEXT;
+            break;
+        case TW_MR_DATA_NACK:
+            twiData[twiIndex++] = TWDR;
+            stop(false);
+            break;
+
+        // address or data not acknowledged, arbitration lost, bus error
+        default:
+            stop(true);
+            break;
+    }
+
+}
+
+bool TwiTransport::startWrite(uint8_t address, const uint8_t *data, uint8_t length){
+    return start(address << 1 | TW_WRITE, (uint8_t *)data, length);
+}
+
+bool TwiTransport::startRead(uint8_t address, uint8_t *data, uint8_t length){
+    return length > 0 && start(address << 1 | TW_READ, data, length);
+}
+
+bool TwiTransport::isBusy(){
+    return twiBusy;
+}
+
+bool TwiTransport::failed(){
+    return twiFailed;
+}
+
+void TwiTransport::onComplete(void (*handler)(void)){
+    twiHandler = handler;
+}
+
+#else
+
+#include "Wire.h"
+
+static bool twiFailed = false;
+
+void TwiTransport::begin(){
+    Wire.begin();
+}
+
+bool TwiTransport::startWrite(uint8_t address, const uint8_t *data, uint8_t length){
+
+    Wire.beginTransmission(address);
+    for (uint8_t i = 0; i < length; i++) Wire.write(data[i]);
+    twiFailed = Wire.endTransmission() != 0;
+    return true;
+
+}
+
+bool TwiTransport::startRead(uint8_t address, uint8_t *data, uint8_t length){
+
+    uint8_t received = Wire.requestFrom(address, length);
+
+    for (uint8_t i = 0; i < received; i++) data[i] = Wire.read();
+    twiFailed = received != length;
+    return true;
+
+}
+
+bool TwiTransport::isBusy(){
+    return false;
+}
+
+bool TwiTransport::failed(){
+    return twiFailed;
+}
+
+// a transfer is over before its start call returns, there is nothing to call
+void TwiTransport::onComplete(void (*handler)(void)){
+    (void)handler;
+}
+
+#endif
+
+bool TwiTransport::write(uint8_t address, const uint8_t *data, uint8_t length){
+
+    if (!startWrite(address, data, length)) return false;
+    while (isBusy());
+    return !failed();
+
+}
+
+bool TwiTransport::read(uint8_t address, uint8_t *data, uint8_t length){
+
+    if (!startRead(address, data, length)) return false;
+    while (isBusy());
+    return !failed();
+
+}
@@ -0,0 +1,66 @@
+#ifndef TwiTransport_h
+#define TwiTransport_h
+
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+
+// I2C master transport under the DS2482.
+//
+// By default it goes through the Wire library and a transfer is over
+// when the start call returns. Built with TWI_ASYNC=1 on an AVR it runs
+// the TWI hardware from its interrupt instead: a start call only sends
+// the START condition, the rest of the transfer happens in the interrupt
+// and the handler given to onComplete() is called from it at the end,
+// where it may start the next transfer. The Wire library must not be
+// linked then, it has its own TWI interrupt: env:uno_async leaves it out
+// and a second TWI_vect would not link.
+//
+//   TwiTransport::begin();
+//   TwiTransport::write(0x18, cmd, 2);   // blocking, false on a NACK
+
+#include <inttypes.h>
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+// Set to 1 (build_flags = -D TWI_ASYNC=1) for the interrupt driven
+// transport, DS2482::transfer() then runs while the CPU sleeps. The
+// native build keeps the synchronous transport but runs the same
+// transfer() state machine on it.
+#ifndef TWI_ASYNC
+#define TWI_ASYNC 0
+#endif
+
+#define TWI_FREQ 100000L
+
+class TwiTransport
+{
+public:
+
+    static void begin();
+
+    // start a transfer to the 7 bit address, false if one is still
+    // running. A write of no bytes only checks that the address answers.
+    // data must stay valid until the transfer is over.
+    static bool startWrite(uint8_t address, const uint8_t *data, uint8_t length);
+    static bool startRead(uint8_t address, uint8_t *data, uint8_t length);
+
+    static bool isBusy();
+
+    // the last transfer was not acknowledged or lost the bus
+    static bool failed();
+
+    // called from the interrupt when a transfer is over, TWI_ASYNC only
+    static void onComplete(void (*handler)(void));
+
+    // start and wait, true if the transfer was acknowledged
+    static bool write(uint8_t address, const uint8_t *data, uint8_t length);
+    static bool read(uint8_t address, uint8_t *data, uint8_t length);
+};
+
+#endif
@@ -9,22 +9,122 @@
 #endif
 
 #include <Arduino.h>
-#include <Wire.h>
+#include <TwiTransport.h>
 #include <DS2482.h>
 #include <DS18B20_DS2482.h>
 #include <DS2413.h>
+#include <JsonWriter.h>
+#include <FrameWriter.h>
 #include <avr/sleep.h>
 #include <avr/power.h>
+#include <avr/eeprom.h>
 
-DS2482 ds(0);                        // 1 wire interface
-DS18B20_DS2482 DS18B20_devices(&ds); // temperature sensors
-DS2413 DS2413_devices(&ds);          // 1 wire PIO switchs
+// 1 for a DS2482-100, 8 for a DS2482-800 with a run of devices on each
+// channel, select with build_flags = -D BRIDGE_CHANNELS=8
+#ifndef BRIDGE_CHANNELS
+#define BRIDGE_CHANNELS 1
+#endif
+
+// DS2482 chips on the I2C bus, at addresses 0 up to BRIDGE_COUNT - 1,
+// select with build_flags = -D BRIDGE_COUNT=4. Each one keeps its own
+// list of up to MAXDEVICES devices; four of them fit an ATmega328 with
+// -D MAXDEVICES=8.
+#ifndef BRIDGE_COUNT
+#define BRIDGE_COUNT 1
+#endif
+
+static_assert(BRIDGE_COUNT >= 1 && BRIDGE_COUNT <= MAXBRIDGES, "BRIDGE_COUNT is 1 to MAXBRIDGES");
+static_assert(BRIDGE_COUNT * DEVICE_LIST_BYTES <= E2END + 1,
+    "the device lists do not fit the EEPROM, lower MAXDEVICES (-D MAXDEVICES=8 for four bridges)");
+
+DS2482 bridges[BRIDGE_COUNT] = {     // 1 wire interfaces
+    DS2482(0, BRIDGE_CHANNELS),
+#if BRIDGE_COUNT > 1
+    DS2482(1, BRIDGE_CHANNELS),
+#endif
+#if BRIDGE_COUNT > 2
+    DS2482(2, BRIDGE_CHANNELS),
+#endif
+#if BRIDGE_COUNT > 3
+    DS2482(3, BRIDGE_CHANNELS),
+#endif
+};
+DS18B20_DS2482 DS18B20_devices[BRIDGE_COUNT]; // temperature sensors, one driver per bridge
+DS2413 DS2413_devices[BRIDGE_COUNT];          // 1 wire PIO switchs
+
+// Temperature acquisition modes used by getData(), select with build_flags = -D ACQUIRE_MODE=2
+#define ACQUIRE_PER_DEVICE 0 // convert and read each sensor in turn
+#define ACQUIRE_BROADCAST  1 // convert every sensor at once with skip ROM, then read each one
+#define ACQUIRE_ALARM      2 // convert every sensor at once, then read only the sensors an
+                             // alarm search finds outside AlarmBand of their last reading
+
+#ifndef ACQUIRE_MODE
+#define ACQUIRE_MODE ACQUIRE_BROADCAST
+#endif
+
+// Temperature reads between keyframes, select with build_flags = -D READ_MODE=0,
+// a keyframe reads every sensor in full with the CRC whatever the mode
+#ifndef READ_MODE
+#define READ_MODE READ_SHORT
+#endif
+
+// Report formats, select with build_flags = -D REPORT_FORMAT=1
+#define REPORT_JSON   0 // one JSON line per report, see template.json
+#define REPORT_BINARY 1 // one COBS encoded frame per report, see getFrame()
+
+#ifndef REPORT_FORMAT
+#define REPORT_FORMAT REPORT_JSON
+#endif
 
-int DevicesCount = 0;
+#define FRAME_REPORT  0x01 // frame type of a report of every device
+#define FRAME_CHANGES 0x02 // frame type of a report of the devices that changed
+#define FRAME_SWITCH  0x03 // frame type of a switch event, one switch record
+#define FRAME_DEVICE  0x04 // frame type of a device added / removed event
+
+// Switches are sampled this often between reports, a pin change is sent
+// straight away as a switch event
+#define SWITCH_POLL_MS    250
+#define SWITCH_POLL_TICKS (uint16_t)((uint32_t)SWITCH_POLL_MS * (F_CPU / 1024) / 1000)
+#define SWITCH_UNKNOWN    0xFF // no valid sample yet
+
+// Background search passes after each report, one device each, so a
+// round over N devices takes N / REDISCOVER_PASSES reports
+#define REDISCOVER_PASSES 2
+
+// Report modes, select with build_flags = -D REPORT_MODE=1
+#define REPORT_ALL     0 // every device in every report
+#define REPORT_CHANGES 1 // devices that moved past their deadband, every device in a keyframe
+
+#ifndef REPORT_MODE
+#define REPORT_MODE REPORT_ALL
+#endif
+
+uint8_t DevicesCount[BRIDGE_COUNT];
 int TemperatureCount = 0;
 int SwitchCount = 0;
 
+uint8_t AcquisitionMode = ACQUIRE_MODE;
+uint8_t ReadMode = READ_MODE;
+uint8_t TemperatureDecimals = 2;           // decimals in the reported values
+uint8_t TemperatureUnit = TEMP_CELSIUS;    // or TEMP_FAHRENHEIT
+uint8_t ReportFormat = REPORT_FORMAT;
+uint8_t FrameSequence = 0;                 // lets the host spot lost frames
+uint8_t ReportMode = REPORT_MODE;
+uint8_t KeyframeInterval = 15;             // reports, a full report every 5 minutes
+uint8_t KeyframeCountdown = 0;
+int16_t TemperatureDeadband = 16;          // raw 1/128 degrees C, 0.125 C
+int8_t AlarmBand = 1;                      // whole degrees C, ACQUIRE_ALARM thresholds
+
+// per bridge, then per index in the device list of the bridge
+int16_t Reading[BRIDGE_COUNT][MAXDEVICES];  // this report, raw temperature or PIO status
+int16_t Reported[BRIDGE_COUNT][MAXDEVICES]; // last value sent for each device
+uint32_t ReportMask[BRIDGE_COUNT];          // bit per device in this report
+uint32_t AlarmMask[BRIDGE_COUNT];           // bit per sensor found by the alarm search
+uint8_t SwitchPins[BRIDGE_COUNT][MAXDEVICES]; // pin bits last seen by pollSwitches()
+
 volatile int f_timer=0;
+volatile bool f_conversion=false; // conversion time has passed
+volatile bool f_switchPoll=false; // time to sample the switches
 
 
 
@@ -48,16 +148,16 @@ void Sleep(void)
   
   // Enable peripherals.
   power_all_enable();
+#if TWI_ASYNC
+  TwiTransport::begin(); // the TWI wants setting up again after its clock was off
+#endif
 }
 
 void i2cDetect()
 {
     for (uint8_t i2caddress = 1; i2caddress < 127; i2caddress++)
     {
-        Wire.beginTransmission(i2caddress);
-        uint8_t error = Wire.endTransmission();
-
-        if (error == 0)
+        if (TwiTransport::write(i2caddress, NULL, 0))
         {
             TRACE("I2C device found at address 0x");
             if (i2caddress < 16) TRACE("0");
@@ -69,119 +169,538 @@ void i2cDetect()
 
 void deviceCount()
 {
-    for (uint8_t i = 0; i < DevicesCount; i++)
+    TemperatureCount = 0;
+    SwitchCount = 0;
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
     {
-        DeviceAddress &address = ds.getDeviceAtIndex(i);
-        if (DS18B20_devices.validFamily(address)) TemperatureCount ++;
-        if (DS2413_devices.validFamily(address)) SwitchCount ++;       
+        TemperatureCount += DS18B20_devices[b].getDeviceCount();
+        SwitchCount += DS2413_devices[b].getDeviceCount();
     }
 
     TRACE("Temperature Devices: " + (String)TemperatureCount + "\n");
     TRACE("Switch Devices: " + (String)SwitchCount + "\n");
 }
 
-void getData()
+#ifdef __AVR__
+// Free RAM is painted at startup, the untouched bytes left above the
+// heap show the deepest the stack has ever reached.
+#define RAM_PAINT 0xC5
+
+extern uint8_t __heap_start;
+extern void *__brkval;
+
+void paintRam()
+{
+    uint8_t *p = __brkval ? (uint8_t *)__brkval : &__heap_start;
+    uint8_t *sp = (uint8_t *)SP;
+
+    while (p < sp) *p++ = RAM_PAINT;
+}
+
+// lowest free RAM between heap and stack since startup, in bytes
+uint16_t ramLowWater()
+{
+    uint8_t *p = __brkval ? (uint8_t *)__brkval : &__heap_start;
+    uint16_t count = 0;
+
+    while (p < (uint8_t *)SP && *p++ == RAM_PAINT) count++;
+    return count;
+}
+#endif
+
+#if DS2482_STATS
+// DS2482 bus statistics since the last report, all bridges together
+void printStats(JsonWriter &json)
+{
+    DS2482Stats stats = bridges[0].getStats();
+
+    for (uint8_t b = 1; b < BRIDGE_COUNT; b++)
+    {
+        const DS2482Stats &more = bridges[b].getStats();
+
+        stats.transactions += more.transactions;
+        stats.bytes += more.bytes;
+        stats.busyPolls += more.busyPolls;
+        stats.resets += more.resets;
+        stats.timeouts += more.timeouts;
+        stats.writeTime += more.writeTime;
+        stats.readTime += more.readTime;
+        stats.busyTime += more.busyTime;
+        stats.resetTime += more.resetTime;
+    }
+
+    json.beginObject(F("stats"));
+    json.number(F("transactions"), stats.transactions);
+    json.number(F("bytes"), stats.bytes);
+    json.number(F("busypolls"), stats.busyPolls);
+    json.number(F("resets"), stats.resets);
+    json.number(F("timeouts"), stats.timeouts);
+    json.number(F("writeus"), stats.writeTime);
+    json.number(F("readus"), stats.readTime);
+    json.number(F("busyus"), stats.busyTime);
+    json.number(F("resetus"), stats.resetTime);
+    json.endObject();
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++) bridges[b].resetStats();
+}
+#endif
+
+// Binary report, all values little endian:
+//   type (FRAME_REPORT or FRAME_CHANGES), sequence, temperature count,
+//   switch count, one record per temperature sensor then one per switch:
+//   ROM (8 bytes), raw temperature (int16, 1/128 degrees C), PIO status
+// a switch record carries a raw temperature of 0, a temperature record
+// a PIO status of 0, the PIO status is -1 if the switch did not answer
+void frameRecord(FrameWriter &frame, uint8_t* address, int16_t raw, uint8_t pio)
+{
+    frame.write(address, 8);
+    frame.writeInt16(raw);
+    frame.write(pio);
+}
+
+void getFrame(bool keyframe)
+{
+    FrameWriter frame(Serial);
+    uint8_t temperatures = 0;
+    uint8_t switches = 0;
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
+        {
+            if (!(ReportMask[b] & (1UL << i))) continue;
+            if (DS18B20_devices[b].validFamily(bridges[b].getDeviceAtIndex(i))) temperatures++;
+            else switches++;
+        }
+
+    frame.write((uint8_t)(keyframe ? FRAME_REPORT : FRAME_CHANGES));
+    frame.write(FrameSequence++);
+    frame.write(temperatures);
+    frame.write(switches);
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
+        {
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if ((ReportMask[b] & (1UL << i)) && DS18B20_devices[b].validFamily(address))
+                frameRecord(frame, address, Reading[b][i], 0);
+        }
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
+        {
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if ((ReportMask[b] & (1UL << i)) && DS2413_devices[b].validFamily(address))
+                frameRecord(frame, address, 0, Reading[b][i]);
+        }
+
+    frame.end();
+}
+
+void jsonSwitch(JsonWriter &json, const __FlashStringHelper *key, uint8_t* address, int16_t state)
+{
+    json.beginObject(key);
+    json.address(F("address"), address);
+
+    // print PIO states
+    json.beginString(F("pioa"));
+    json.print(state & (1 << PIOA_PIN_STATE) ? '1' : '0');
+    json.endString();
+    json.beginString(F("piob"));
+    json.print(state & (1 << PIOB_PIN_STATE) ? '1' : '0');
+    json.endString();
+
+    json.endObject();
+}
+
+void getJson(bool keyframe)
 {
-    Serial.print("{"); // opening json
+    JsonWriter json(Serial);
 
-    int a = 0;
+    json.beginObject(); // opening json
 
     // get temperature sensors
-    Serial.print("\"temperatures\": [");
-    if (TemperatureCount > 0)
-    {        
-        for (uint8_t i = 0; i < DevicesCount; i++)
+    json.beginArray(F("temperatures"));
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
         {
-            DeviceAddress &address = ds.getDeviceAtIndex(i);
-            if (DS18B20_devices.validFamily(address)){
-                Serial.print("{");
-                // print serial number
-                String SerialNumber = "";
-                for (uint8_t x = 0; x < 8; x++)
-                {
-                    if (address[x] < 0x10) SerialNumber += "0";
-                    SerialNumber += String(address[x], HEX);
-                    if (x < 7) SerialNumber += "-";
-                }
-
-                Serial.print("\"address\": \"" + SerialNumber + "\",");
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if ((ReportMask[b] & (1UL << i)) && DS18B20_devices[b].validFamily(address)){
+                char value[TEMP_STRING_LENGTH];
+
+                json.beginObject();
+                json.address(F("address"), address);
 
                 // print temperature
-                Serial.print("\"value\": \"");
-                DS18B20_devices.requestTemperaturesByAddress(address);
-                Serial.print(DS18B20_devices.getTempC(address));
-                
-                if (a < (TemperatureCount - 1)) Serial.print("\"},");
-                else Serial.print("\"}");
-                a++;
+                DS18B20_DS2482::rawToString(Reading[b][i], value, TemperatureDecimals, TemperatureUnit);
+                json.beginString(F("value"));
+                json.print(value);
+                json.endString();
+
+                json.endObject();
             }
         }
-    }
+    json.endArray();
 
-    Serial.print("],");
-    
     // get switch sensors
-    Serial.print("\"switches\": [");
-    if (SwitchCount > 0)
+    json.beginArray(F("switches"));
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
+        {
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if ((ReportMask[b] & (1UL << i)) && DS2413_devices[b].validFamily(address))
+                jsonSwitch(json, NULL, address, Reading[b][i]);
+        }
+    json.endArray();
+
+    // a consumer rebuilding the full state starts from a keyframe
+    if (ReportMode == REPORT_CHANGES) json.number(F("keyframe"), keyframe);
+
+#ifdef __AVR__
+    json.number(F("ramfree"), ramLowWater());
+#endif
+
+#if DS2482_STATS
+    printStats(json);
+#endif
+
+    json.endObject();
+    json.print('\n'); // flushes the report
+}
+
+// smallest temperature change worth reporting in REPORT_CHANGES mode
+int16_t deadband(uint8_t family)
+{
+    switch (family)
+    {
+        case DS18S20MODEL: return 64; // 0.5 C, the register resolution
+        default: return TemperatureDeadband;
+    }
+}
+
+// One alarm search per bridge after the conversion marks the sensors
+// that have left the band set by armAlarm() in AlarmMask
+void findAlarms()
+{
+    DeviceAddress address;
+    int8_t index;
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+    {
+        AlarmMask[b] = 0;
+        DS18B20_devices[b].resetAlarmSearch();
+        while (DS18B20_devices[b].alarmSearch(address))
+        {
+            index = bridges[b].getDeviceIndex(address);
+            if (index >= 0) AlarmMask[b] |= (1UL << index);
+        }
+    }
+}
+
+// centre the alarm thresholds of a sensor on its reading, the
+// thresholds are not copied to the EEPROM to spare it
+void armAlarm(uint8_t bridge, uint8_t* address, int16_t raw)
+{
+    if (raw <= DEVICE_DISCONNECTED_RAW) return;
+
+    int8_t whole = raw >> 7; // the sensor compares whole degrees, rounded down
+    DS18B20_devices[bridge].setAlarmThresholds(address, whole - AlarmBand, whole + AlarmBand);
+}
+
+// Read the sensors due in this report into Reading[]. The sensors at the
+// same list index on every bridge are read together with getTemps(), so
+// with several bridges their 1-Wire time overlaps.
+void readTemperatures(bool readAll)
+{
+    DS18B20_DS2482 *sensors[BRIDGE_COUNT];
+    uint8_t *addresses[BRIDGE_COUNT];
+    int16_t values[BRIDGE_COUNT];
+    uint8_t from[BRIDGE_COUNT]; // bridge of each entry
+    uint8_t count;
+
+    for (uint8_t i = 0; i < MAXDEVICES; i++)
+    {
+        count = 0;
+
+        for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        {
+            if (i >= DevicesCount[b]) continue;
+
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if (!DS18B20_devices[b].validFamily(address)) continue;
+
+            // unplugged, reported once by rediscoverDevices()
+            if (bridges[b].getDeviceInfoAtIndex(i).flags & DEVICE_MISSING) continue;
+
+            // the others keep their last reading
+            if (AcquisitionMode == ACQUIRE_ALARM && !readAll && !(AlarmMask[b] & (1UL << i))) continue;
+
+            // in the other modes loop() has already converted every sensor
+            if (AcquisitionMode == ACQUIRE_PER_DEVICE) DS18B20_devices[b].requestTemperaturesByAddress(address);
+
+            sensors[count] = &DS18B20_devices[b];
+            addresses[count] = address;
+            values[count] = Reading[b][i];
+            from[count++] = b;
+        }
+
+        if (count == 0) continue;
+        DS18B20_DS2482::getTemps(sensors, addresses, values, count);
+
+        for (uint8_t n = 0; n < count; n++)
+        {
+            Reading[from[n]][i] = values[n];
+            if (AcquisitionMode == ACQUIRE_ALARM) armAlarm(from[n], addresses[n], values[n]);
+        }
+    }
+}
+
+// Read every device into Reading[] and mark the ones to report in
+// ReportMask, returns the number of devices to report. In ACQUIRE_ALARM
+// mode only the sensors in AlarmMask are read unless readAll is set,
+// the others keep their last reading.
+uint8_t readDevices(bool keyframe, bool readAll)
+{
+    uint8_t count = 0;
+    bool changed;
+
+    readTemperatures(readAll);
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
     {
-        a = 0;
-        for (uint8_t i = 0; i < DevicesCount; i++)
+        DS2482 &ds = bridges[b];
+
+        ReportMask[b] = 0;
+
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
         {
             DeviceAddress &address = ds.getDeviceAtIndex(i);
-            if (DS2413_devices.validFamily(address)){
-                Serial.print("{");
-                // print serial number
-                String SerialNumber = "";
-                for (uint8_t x = 0; x < 8; x++)
-                {
-                    if (address[x] < 0x10) SerialNumber += "0";
-                    SerialNumber += String(address[x], HEX);
-                    if (x < 7) SerialNumber += "-";
-                }
-
-                Serial.print("\"address\": \"" + SerialNumber + "\",");
-
-                // print PIO states
-                int state = DS2413_devices.getPIOState(address);
-
-                uint8_t PIOAState = 0;
-                uint8_t PIOBState = 0;
-
-                if (state & (1 << 0)) PIOAState = 1;
-                if (state & (1 << 2)) PIOBState = 1;
-
-                Serial.print("\"pioa\": \"" + String(PIOAState) + "\",");
-                Serial.print("\"piob\": \"" + String(PIOBState) + "\"");
-                
-                if (a < (SwitchCount - 1)){
-                    Serial.print("},");
-                } 
-                else{
-                    Serial.print("}");
-                }
-                a++;
+
+            // unplugged, reported once by rediscoverDevices()
+            if (ds.getDeviceInfoAtIndex(i).flags & DEVICE_MISSING) continue;
+
+            if (DS18B20_devices[b].validFamily(address)){
+                changed = abs((int32_t)Reading[b][i] - Reported[b][i]) >= deadband(address[0]);
+            }
+            else if (DS2413_devices[b].validFamily(address)){
+                Reading[b][i] = DS2413_devices[b].getPIOState(address);
+                changed = Reading[b][i] != Reported[b][i];
+            }
+            else continue;
+
+            // compare against the last reported value, not the last reading,
+            // so a slow drift is still reported once it adds up
+            if (keyframe || changed){
+                Reported[b][i] = Reading[b][i];
+                ReportMask[b] |= (1UL << i);
+                count++;
             }
         }
-    }   
-    
-    Serial.print("]}\n");
+    }
+
+    return count;
+}
+
+// Device event, {"device": {"address": ...,"event": "added"}} or
+// "removed", or a FRAME_DEVICE frame:
+//   type, sequence, event (DEVICE_ADDED or DEVICE_REMOVED), 0, ROM (8 bytes)
+void sendDeviceEvent(uint8_t* address, uint8_t event)
+{
+    if (ReportFormat == REPORT_BINARY)
+    {
+        FrameWriter frame(Serial);
+
+        frame.write((uint8_t)FRAME_DEVICE);
+        frame.write(FrameSequence++);
+        frame.write(event);
+        frame.write((uint8_t)0);
+        frame.write(address, 8);
+        frame.end();
+        return;
+    }
+
+    JsonWriter json(Serial);
+
+    json.beginObject();
+    json.beginObject(F("device"));
+    json.address(F("address"), address);
+    json.beginString(F("event"));
+    json.print(event == DEVICE_ADDED ? F("added") : F("removed"));
+    json.endString();
+    json.endObject();
+    json.endObject();
+    json.print('\n');
+}
+
+// Switch event, {"switch": {"address": ...,"pioa": ...,"piob": ...}} or
+// a FRAME_SWITCH frame holding the one switch record
+void sendSwitchEvent(uint8_t* address, uint8_t state)
+{
+    if (ReportFormat == REPORT_BINARY)
+    {
+        FrameWriter frame(Serial);
+
+        frame.write((uint8_t)FRAME_SWITCH);
+        frame.write(FrameSequence++);
+        frame.write((uint8_t)0);
+        frame.write((uint8_t)1);
+        frameRecord(frame, address, 0, state);
+        frame.end();
+        return;
+    }
+
+    JsonWriter json(Serial);
+
+    json.beginObject();
+    jsonSwitch(json, F("switch"), address, state);
+    json.endObject();
+    json.print('\n');
+}
+
+// Sample every switch and send an event for each one whose pins changed
+// since the last sample. Reading a DS2413 needs no conversion, so this
+// runs between reports without holding up the temperatures.
+void pollSwitches()
+{
+    int state;
+    uint8_t pins;
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        for (uint8_t i = 0; i < DevicesCount[b]; i++)
+        {
+            DeviceAddress &address = bridges[b].getDeviceAtIndex(i);
+            if (!DS2413_devices[b].validFamily(address)) continue;
+            if (bridges[b].getDeviceInfoAtIndex(i).flags & DEVICE_MISSING) continue;
+
+            state = DS2413_devices[b].getPIOState(address);
+            if (state < 0) continue; // try again at the next poll
+
+            pins = state & ((1 << PIOA_PIN_STATE) | (1 << PIOB_PIN_STATE));
+            if (pins == SwitchPins[b][i]) continue;
+
+            // the first sample only sets the reference, the reports carry the state
+            if (SwitchPins[b][i] != SWITCH_UNKNOWN) sendSwitchEvent(address, state);
+            SwitchPins[b][i] = pins;
+        }
+}
+
+// Sample the switches every SWITCH_POLL_MS with compare match B
+void startSwitchPolling()
+{
+    if (SwitchCount == 0 || (TIMSK1 & (1 << OCIE1B))) return;
+
+    OCR1B = TCNT1 + SWITCH_POLL_TICKS;
+    TIFR1 = (1 << OCF1B);
+    TIMSK1 |= (1 << OCIE1B);
+}
+
+// A few passes of the background search keep the device lists current
+// without a full scan: a new device gets the next free index and is read
+// from the next report on, a device that stops answering keeps its index
+// but is no longer read until it answers the search again. The passes go
+// to the bridges in turn, so more bridges cost no more bus time per report
+// and a round still takes N / REDISCOVER_PASSES reports over N devices.
+void rediscoverDevices()
+{
+    static uint8_t b = 0;
+    uint8_t index;
+    uint8_t event;
+
+    for (uint8_t n = 0; n < REDISCOVER_PASSES; n++)
+    {
+        DS2482 &ds = bridges[b];
+
+        event = ds.rediscover(&index);
+        if (event != 0)
+        {
+            if (event == DEVICE_ADDED)
+            {
+                DevicesCount[b] = ds.getDeviceCount();
+                DS18B20_devices[b].begin(); // resolution and power mode of the new sensor
+                DS2413_devices[b].begin();
+                ds.saveDeviceList(b * DEVICE_LIST_BYTES); // a warm boot will expect it
+                deviceCount();
+                startSwitchPolling();
+                Reading[b][index] = DEVICE_DISCONNECTED_RAW; // read in full first
+                Reported[b][index] = (int16_t)0x8000; // no reading, in the next report whatever the mode
+            }
+            SwitchPins[b][index] = SWITCH_UNKNOWN;
+
+            sendDeviceEvent(ds.getDeviceAtIndex(index), event);
+        }
+
+        if (++b == BRIDGE_COUNT) b = 0;
+    }
+}
+
+void getData()
+{
+    // every KeyframeInterval reports every sensor is read and reported
+    bool readAll = KeyframeCountdown == 0;
+    bool keyframe = ReportMode == REPORT_ALL || readAll;
+
+    if (readAll) KeyframeCountdown = KeyframeInterval;
+    KeyframeCountdown--;
+
+    if (AcquisitionMode == ACQUIRE_ALARM && !readAll) findAlarms();
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        DS18B20_devices[b].setReadMode(readAll ? READ_FULL : ReadMode);
+
+    // nothing moved, the next keyframe shows the bridge is still alive
+    if (readDevices(keyframe, readAll) > 0 || keyframe)
+    {
+        if (ReportFormat == REPORT_BINARY) getFrame(keyframe);
+        else getJson(keyframe);
+    }
+
+    // the bus is free until the next report
+    rediscoverDevices();
 }
 
 void setup()
 {
 
+#ifdef __AVR__
+    paintRam();
+#endif
+
     Serial.begin(115200);
 
     TRACE("starting I2C: ");
-    Wire.begin();
-    i2cDetect();
+    TwiTransport::begin();
+#ifdef DEBUG
+    i2cDetect(); // 126 addresses, only worth it when someone reads the trace
+#endif
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+    {
+        DS2482 &ds = bridges[b];
+
+        // the chip kept its speed and channel if only the MCU restarted
+        TRACE("DS2482-100 reset: ");
+        ds.deviceReset();
+        ds.reset();
 
-    TRACE("DS2482-100 reset: ");
-    ds.reset();
+        // a warm boot takes the device list from the EEPROM if one search walk
+        // finds the same devices, otherwise the bus is enumerated again, each
+        // bridge keeps its list in its own part of the EEPROM
+        bool warm = ds.loadDeviceList(b * DEVICE_LIST_BYTES) && ds.verifyDeviceList();
 
-    //search for devices and print address = true
-    TRACE("DS2482-100 scan: \n");
-    DevicesCount = ds.devicesCount(true); // count available 1-wire devices
+        //search for devices and print address = true
+        TRACE("DS2482-100 scan: \n");
+        if (!warm) ds.devicesCount(true); // the only search, every driver works from this list
+        DevicesCount[b] = ds.getDeviceCount();
+
+        DS18B20_devices[b].setOneWire(&ds);
+        DS18B20_devices[b].begin(); // cache resolution and power mode of the temperature sensors
+        DS2413_devices[b].setOneWire(&ds);
+        DS2413_devices[b].begin();
+
+        // only the bytes that changed are written, such as the speed
+        // found by the drivers for a device that was not probed yet
+        ds.saveDeviceList(b * DEVICE_LIST_BYTES);
+
+        for (uint8_t i = 0; i < MAXDEVICES; i++) SwitchPins[b][i] = SWITCH_UNKNOWN;
+    }
 
     deviceCount(); // get count of temperature and switch devices
 
@@ -204,6 +723,56 @@ void setup()
     
     /* Enable the timer overlow interrupt. */
     TIMSK1=0x01;
+
+    startSwitchPolling();
+
+    f_timer = 4; // first report straight away rather than after a full period
+}
+
+// Wake up from Sleep() once a conversion started by startConversion()
+// has had its worst case time to complete. Timer0 is stopped while
+// sleeping so millis() cannot be used for this.
+void startConversionTimer(int16_t ms)
+{
+    /* Timer1 counts at F_CPU / 1024, 15.625 ticks per ms at 16MHz */
+    OCR1A = TCNT1 + (uint16_t)((uint32_t)ms * (F_CPU / 1024) / 1000) + 1;
+    f_conversion = false;
+
+    /* Clear a stale compare match and enable the compare interrupt. */
+    TIFR1 = (1 << OCF1A);
+    TIMSK1 |= (1 << OCIE1A);
+}
+
+// Convert on every bridge with sensors at once, returns the longest
+// conversion time, 0 if no sensor answered
+int16_t startConversions()
+{
+    int16_t delms = 0;
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        if (DS18B20_devices[b].getDeviceCount() > 0)
+            delms = max(delms, DS18B20_devices[b].startConversion());
+
+    return delms;
+}
+
+bool isConversionPending()
+{
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        if (DS18B20_devices[b].isConversionPending()) return true;
+
+    return false;
+}
+
+// true once every bridge has completed its conversion, see isReady()
+bool isConversionReady(bool deadline)
+{
+    bool ready = true;
+
+    for (uint8_t b = 0; b < BRIDGE_COUNT; b++)
+        if (!DS18B20_devices[b].isReady(deadline)) ready = false;
+
+    return ready;
 }
 
 ISR(TIMER1_OVF_vect)
@@ -212,12 +781,50 @@ ISR(TIMER1_OVF_vect)
    f_timer++;   
 }
 
+ISR(TIMER1_COMPA_vect)
+{
+   /* one shot, disabled until the next conversion */
+   TIMSK1 &= ~(1 << OCIE1A);
+   f_conversion = true;
+}
+
+ISR(TIMER1_COMPB_vect)
+{
+   /* periodic, the counter wraps with the compare value */
+   OCR1B += SWITCH_POLL_TICKS;
+   f_switchPoll = true;
+}
+
 void loop()
 {
    if(f_timer >= 4) // 20 seconds has passed
    {       
+       f_timer = 0;
+       int16_t delms = 0;
+
+       // start the conversion and sleep until it is complete
+       if (AcquisitionMode != ACQUIRE_PER_DEVICE && TemperatureCount > 0)
+           delms = startConversions();
+
+       if (delms > 0) startConversionTimer(delms);
+       else getData();
+   }
+
+   // collect the results once the conversion is complete,
+   // woken by the compare match or the overflow tick
+   if (isConversionPending() && isConversionReady(f_conversion))
+   {
+       f_conversion = false;
        getData();
-       f_timer = 0;      
+   }
+
+   // sample the switches, but leave the bus alone during a conversion: it
+   // may be powering parasite sensors and poll() reads the conversion
+   // status from the read slots that follow the convert command
+   if (f_switchPoll)
+   {
+       f_switchPoll = false;
+       if (!isConversionPending()) pollSwitches();
    }
    Sleep();
 }
@@ -10,10 +10,23 @@ import json
 import datetime
 import sys  
 import re
+import struct
 import paho.mqtt.client as mqtt
 
 DEBUG = True
 
+# "json" for the default firmware, "binary" for firmware built with
+# -D REPORT_FORMAT=1
+REPORT_FORMAT = "json"
+
+FRAME_REPORT = 0x01   # every device, a keyframe
+FRAME_CHANGES = 0x02  # only the devices that changed, firmware built with -D REPORT_MODE=1
+FRAME_SWITCH = 0x03   # switch event, a single switch record
+FRAME_DEVICE = 0x04   # device added or removed, event then one ROM
+DEVICE_EVENTS = {1: "added", 2: "removed"}
+RECORD_SIZE = 11
+DEVICE_DISCONNECTED_RAW = -7040
+
 
 def trace(output):
     if DEBUG:
@@ -44,18 +57,96 @@ def on_connect(mqttc, obj, flags, rc):
 def on_disconnect(client, userdata, rc):
     trace("MQTT Disconnected with result code "+str(rc))
 
-def main():
-
-    client = mqtt.Client("P1") #create new instance
-    client.username_pw_set(mqtt_user, mqtt_pass)
-    client.on_connect = on_connect
-    client.on_disconnect = on_disconnect
-    
-
-    ser = serial.Serial('/dev/ttyACM0', 115200, timeout=20)  # open serial port
-    ser.flush()
-   #client.loop_forever()
 
+def cobs_decode(data):
+    """Decode one COBS encoded frame, without the zero delimiter"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError("bad COBS block")
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc16(data, crc=0):
+    """Dallas CRC-16 (CRC-16/ARC) as computed by the firmware"""
+    for b in bytearray(data):
+        crc ^= b
+        for _ in range(8):
+            if crc & 1:
+                crc = (crc >> 1) ^ 0xA001
+            else:
+                crc >>= 1
+    return crc
+
+
+def format_address(rom):
+    return "-".join("{0:02x}".format(b) for b in bytearray(rom))
+
+
+def format_temperature(raw):
+    """raw 1/128 degrees C to the string the JSON report would carry"""
+    if raw <= DEVICE_DISCONNECTED_RAW:
+        raw = -127 * 128
+    sign = "-" if raw < 0 else ""
+    hundredths = (abs(raw) * 100 + 64) // 128
+    return "{0}{1}.{2:02d}".format(sign, hundredths // 100, hundredths % 100)
+
+
+def decode_frame(frame):
+    """Decode a binary report frame into the same structure as the JSON
+    report, returns (sequence, report)"""
+    data = cobs_decode(frame)
+    if len(data) < 6 or crc16(data) != 0:
+        raise ValueError("bad frame CRC")
+    frame_type, sequence, temperatures, switches = struct.unpack_from("<BBBB", data)
+    if frame_type == FRAME_DEVICE:
+        if len(data) != 4 + 8 + 2 or temperatures not in DEVICE_EVENTS:
+            raise ValueError("bad device frame")
+        return sequence, {"device": {
+            "address": format_address(data[4:12]),
+            "event": DEVICE_EVENTS[temperatures]}}
+    if frame_type not in (FRAME_REPORT, FRAME_CHANGES, FRAME_SWITCH):
+        raise ValueError("unknown frame type {0}".format(frame_type))
+    if len(data) != 4 + (temperatures + switches) * RECORD_SIZE + 2:
+        raise ValueError("bad frame length")
+
+    report = {"temperatures": [], "switches": [],
+              "keyframe": 1 if frame_type == FRAME_REPORT else 0}
+    offset = 4
+    for n in range(temperatures + switches):
+        rom = data[offset:offset + 8]
+        raw, pio = struct.unpack_from("<hB", data, offset + 8)
+        offset += RECORD_SIZE
+        if n < temperatures:
+            report["temperatures"].append({
+                "address": format_address(rom),
+                "value": format_temperature(raw)})
+        else:
+            report["switches"].append({
+                "address": format_address(rom),
+                "pioa": "1" if pio & (1 << 0) else "0",
+                "piob": "1" if pio & (1 << 2) else "0"})
+    if frame_type == FRAME_SWITCH:
+        return sequence, {"switch": report["switches"][0]}
+    return sequence, report
+
+
+def publish_switch(client, ssensor):
+    #trace("Topic: " + mqtt_topics[ssensor["address"]])
+    #trace("solarpump: " + ssensor["pioa"])
+    #trace("solarcontrollerpower: " + ssensor["piob"])
+    client.publish(mqtt_topics[ssensor["address"]] + "/hotwater",ssensor["pioa"])
+    client.publish(mqtt_topics[ssensor["address"]] + "/centralheating",ssensor["piob"])
+
+
+def read_json(ser):
+    """Wait for the next JSON report line"""
     while True:
         ser.read(1)
 
@@ -66,32 +157,83 @@ def main():
             data = str1 + str2
 
             ser.flush()
+            return json.loads(data)
+
+
+class FrameReader(object):
+    """Reads binary report frames, each ends with a zero byte"""
+
+    def __init__(self, ser):
+        self.ser = ser
+        self.sequence = None
+
+    def read(self):
+        while True:
+            frame = self.ser.read_until(b"\x00")
+            if not frame.endswith(b"\x00"):
+                continue  # timeout
             try:
-                now = datetime.datetime.now()
-                #trace(str(now))
-                #trace(line)
-                jsonObj = json.loads(data)
+                sequence, report = decode_frame(frame[:-1])
+            except (ValueError, struct.error) as err:
+                trace("Bad frame: {0}".format(err))
+                continue
+            if self.sequence is not None and sequence != (self.sequence + 1) & 0xFF:
+                trace("Lost {0} frames".format((sequence - self.sequence - 1) & 0xFF))
+            self.sequence = sequence
+            return report
 
-                temperature_sensors = jsonObj["temperatures"]
+def main():
 
-                client.connect(mqtt_broker, mqtt_port, 60)
+    client = mqtt.Client("P1") #create new instance
+    client.username_pw_set(mqtt_user, mqtt_pass)
+    client.on_connect = on_connect
+    client.on_disconnect = on_disconnect
+    
 
-                for tsensor in temperature_sensors:
-                    #trace("Topic: " + mqtt_topics[tsensor["address"]])
-                    #trace("Value: " + tsensor["value"])
-                    if float(tsensor["value"]) > -10 and float(tsensor["value"]) < 85:
-                        client.publish(mqtt_topics[tsensor["address"]],tsensor["value"], retain=True)
-
-                switch_sensors = jsonObj["switches"]
-                
-                for ssensor in switch_sensors:
-                    #trace("Topic: " + mqtt_topics[ssensor["address"]])
-                    #trace("solarpump: " + ssensor["pioa"])
-                    #trace("solarcontrollerpower: " + ssensor["piob"])
-                    client.publish(mqtt_topics[ssensor["address"]] + "/hotwater",ssensor["pioa"])
-                    client.publish(mqtt_topics[ssensor["address"]] + "/centralheating",ssensor["piob"])
+    ser = serial.Serial('/dev/ttyACM0', 115200, timeout=20)  # open serial port
+    ser.flush()
+   #client.loop_forever()
+
+    frames = FrameReader(ser)
+
+    while True:
+        try:
+            now = datetime.datetime.now()
+            #trace(str(now))
+            if REPORT_FORMAT == "binary":
+                jsonObj = frames.read()
+            else:
+                jsonObj = read_json(ser)
+
+            # a switch changed between reports
+            if "switch" in jsonObj:
+                client.connect(mqtt_broker, mqtt_port, 60)
+                publish_switch(client, jsonObj["switch"])
                 client.disconnect()
-            except Exception as err:
-                trace("Failed to parse json: {0}".format(err))
+                continue
+
+            # a device was plugged in or unplugged, give it a topic in
+            # mqtt_topics to publish its values
+            if "device" in jsonObj:
+                trace("Device {0} {1}".format(jsonObj["device"]["address"], jsonObj["device"]["event"]))
+                continue
+
+            temperature_sensors = jsonObj["temperatures"]
+
+            client.connect(mqtt_broker, mqtt_port, 60)
+
+            for tsensor in temperature_sensors:
+                #trace("Topic: " + mqtt_topics[tsensor["address"]])
+                #trace("Value: " + tsensor["value"])
+                if float(tsensor["value"]) > -10 and float(tsensor["value"]) < 85:
+                    client.publish(mqtt_topics[tsensor["address"]],tsensor["value"], retain=True)
+
+            switch_sensors = jsonObj["switches"]
+            
+            for ssensor in switch_sensors:
+                publish_switch(client, ssensor)
+            client.disconnect()
+        except Exception as err:
+            trace("Failed to parse json: {0}".format(err))
 if __name__ == "__main__":
     main()